@@ -14,12 +14,124 @@
 #ifndef FS_CONSOLE_H
 #define FS_CONSOLE_H
 
+#include <stdint.h>
+
 #include "FS_DT_Conf.h"
 
 #include "FS_Console_Conf.h"
 
+#include "FS_Supervisor.h"
+
 #define FS_CONSOLE_VT100_CLEAR_SCREEN  "\033[2J\f"
 
+/*------------------------------------------------------------------------------
+------------------- START CONFIGURATION VALIDATION -----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+The sizes below come from the project supplied FS_Console_Conf.h. Check them
+here so that a bad configuration fails the build rather than truncating an
+index at run time.
+*/
+#ifndef FS_CONSOLE_MAX_NUM_COMMANDS
+#error "FS_Console: FS_CONSOLE_MAX_NUM_COMMANDS must be defined in FS_Console_Conf.h"
+#endif
+
+#ifndef FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES
+#error "FS_Console: FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES must be defined in FS_Console_Conf.h"
+#endif
+
+#ifndef FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES
+#error "FS_Console: FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES must be defined in FS_Console_Conf.h"
+#endif
+
+#ifndef FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS
+#error "FS_Console: FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS must be defined in FS_Console_Conf.h"
+#endif
+
+// The built-in 'help' command always occupies one slot of the command table.
+#if FS_CONSOLE_MAX_NUM_COMMANDS < 1
+#error "FS_Console: FS_CONSOLE_MAX_NUM_COMMANDS must be at least 1"
+#endif
+
+// Room for at least one character plus the NULL terminator.
+#if FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES < 2
+#error "FS_Console: FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES must be at least 2"
+#endif
+
+#if FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES < 2
+#error "FS_Console: FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES must be at least 2"
+#endif
+
+// Slot 0 always holds the default IO stream.
+#if FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS < 1
+#error "FS_Console: FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS must be at least 1"
+#endif
+
+#if ( FS_CONSOLE_MAX_NUM_COMMANDS > UINT32_MAX ) || \
+    ( FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES > UINT32_MAX ) || \
+    ( FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES > UINT32_MAX ) || \
+    ( FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS > UINT32_MAX )
+#error "FS_Console: configured sizes must fit in 32 bits"
+#endif
+
+/*------------------------------------------------------------------------------
+-------------------- END CONFIGURATION VALIDATION ------------------------------
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+-------------------- START CONFIGURED INDEX TYPES ------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Each index type is the narrowest unsigned type able to hold its configured size
+(not just the largest index), so loops of the form 'i <= ptr' and length
+calculations such as 'ptr + 1' cannot wrap.
+*/
+
+// Indexes/lengths within FS_Console_Input_t::buffer.
+#if FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES <= UINT8_MAX
+typedef uint8_t FS_Console_InputIndex_t;
+#elif FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES <= UINT16_MAX
+typedef uint16_t FS_Console_InputIndex_t;
+#else
+typedef uint32_t FS_Console_InputIndex_t;
+#endif
+
+// Indexes/counts within the command table.
+#if FS_CONSOLE_MAX_NUM_COMMANDS <= UINT8_MAX
+typedef uint8_t FS_Console_CommandIndex_t;
+#elif FS_CONSOLE_MAX_NUM_COMMANDS <= UINT16_MAX
+typedef uint16_t FS_Console_CommandIndex_t;
+#else
+typedef uint32_t FS_Console_CommandIndex_t;
+#endif
+
+// Indexes within the stored IO stream list.
+#if FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS <= UINT8_MAX
+typedef uint8_t FS_Console_StreamIndex_t;
+#elif FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS <= UINT16_MAX
+typedef uint16_t FS_Console_StreamIndex_t;
+#else
+typedef uint32_t FS_Console_StreamIndex_t;
+#endif
+
+/*
+Length argument of output(). Only ever passed in registers or on the stack so
+it is never narrower than 16 bits, which covers all of the fixed console
+strings, but widens if either buffer is configured larger than that.
+*/
+#if ( FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES <= UINT16_MAX ) && \
+    ( FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES <= UINT16_MAX )
+typedef uint16_t FS_Console_OutputLength_t;
+#else
+typedef uint32_t FS_Console_OutputLength_t;
+#endif
+
+/*------------------------------------------------------------------------------
+--------------------- END CONFIGURED INDEX TYPES -------------------------------
+------------------------------------------------------------------------------*/
+
 /*------------------------------------------------------------------------------
 ---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
 ------------------------------------------------------------------------------*/
@@ -27,15 +139,43 @@
 typedef struct
 {
   char buffer[FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES];
-  uint16_t ptr;
+  FS_Console_InputIndex_t ptr;
 
 }FS_Console_Input_t;
 
 typedef struct
 {
+  FS_Console_Input_t * input;
+  _Bool(*inputLineAvailable)(void);
+
+  // Blocks, without spinning, until inputLineAvailable() would return true.
+  void(*waitForInputLine)(void);
+
+  // Also shows the supervisor that the console task is making progress.
+  void(*output)(const char * buf, FS_Console_OutputLength_t numBytes);
+
+  /*
+  Shows the supervisor that the console task is making progress. Commands
+  which run for longer than the console's heartbeat deadline without output
+  or waiting for input must call this periodically.
+  */
+  void(*heartbeat)(void);
+
+}FS_Console_CommandCallbackInterface_t;
+
+typedef struct
+{
+  /*
+  Safe to call from any task on any core. Called from the console task (i.e.
+  from a command callback) output is written out before printf returns.
+  Otherwise it is buffered per core and written out by the drain task; if that
+  core's buffer is full the message is dropped and counted.
+  */
   int(*printf)(const char * fmt, ...);
   _Bool(*registerCommand)( const char * cmd,
-                           void(*callback)( const char * argv, FS_DT_IOStream_t * io ) );
+                           void(*callback)( const char * argv,
+                                            FS_Console_CommandCallbackInterface_t * console ),
+                           const char * helpString );
 
 }FS_Console_t;
 
@@ -60,6 +200,9 @@ typedef struct
   */
   _Bool echoToAllOutputStreams;
 
+  // Optional. If set, the console task registers a heartbeat with it.
+  FS_Supervisor_t * supervisor;
+
 }FS_Console_InitStruct_t;
 
 
@@ -69,6 +212,9 @@ typedef struct
 
   void(*mainLoop)(void * params);
 
+  // Merges the per-core printf output on to the IO streams. Run as its own task.
+  void(*drainLoop)(void * params);
+
   // Called for example when a TelNet/SSH session starts.
   void(*addIOStreamCallback)(FS_DT_IOStream_t * newIO);
 
@@ -77,14 +223,6 @@ typedef struct
 
 }FS_Console_InitReturnsStruct_t;
 
-typedef struct
-{
-  FS_Console_Input_t * input;
-  _Bool(*inputLineAvailable)(void);
-  void(*output)(const char * buf, uint8_t numBytes);
-
-}FS_Console_CommandCallbackInterface_t;
-
 /*------------------------------------------------------------------------------
 ----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
 ------------------------------------------------------------------------------*/
@@ -1,9 +1,24 @@
 #ifndef FS_FILESYSTEM_H
 #define FS_FILESYSTEM_H
 
+#include <stdint.h>
+
+/*
+Minimal file interface. Reads and writes are positional so that callers such
+as FS_LogStore can treat a file as a fixed size region of flash.
+*/
 typedef struct
 {
+  // Opens the file for reading and writing, creating it if necessary. NULL on failure.
+  void *(*open)(const char * path);
+  void(*close)(void * file);
+
+  // Both return false if the full number of bytes could not be transferred.
+  _Bool(*read)(void * file, uint32_t offset, void * buf, uint32_t numBytes);
+  _Bool(*write)(void * file, uint32_t offset, const void * buf, uint32_t numBytes);
 
+  // Commits previously written data to the medium.
+  _Bool(*sync)(void * file);
 
 }FS_Filesystem_t;
 
@@ -0,0 +1,26 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Filesystem_Stdio.h
+ *
+ * @brief FS_Filesystem_t binding onto C stdio, for host builds - header file.
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_FILESYSTEM_STDIO_H
+#define FS_FILESYSTEM_STDIO_H
+
+#include "FS_Filesystem.h"
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Filesystem_StdioInit(FS_Filesystem_t * instance);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+#endif // FS_FILESYSTEM_STDIO_H
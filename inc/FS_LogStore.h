@@ -0,0 +1,96 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_LogStore.h
+ *
+ * @brief Persistent circular log record store - header file.
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_LOGSTORE_H
+#define FS_LOGSTORE_H
+
+#include <stdint.h>
+
+#include "FS_Filesystem.h"
+
+// Longest record payload accepted by FS_LogStore_Append(); longer ones are truncated.
+#ifndef FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES
+#define FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES 256
+#endif
+
+#if FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES < 1 || FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES > UINT16_MAX
+#error "FS_LogStore: FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES must be between 1 and 65535"
+#endif
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  FS_Filesystem_t * fs;
+  const char * path;
+
+  /*
+  The store is divided in to sectors which are written round robin, so every
+  sector sees the same number of rewrites. sectorSizeBytes should match the
+  erase block size of the underlying flash where known.
+  */
+  uint32_t sizeBytes;
+  uint32_t sectorSizeBytes;
+
+}FS_LogStore_InitStruct_t;
+
+typedef struct
+{
+  /*
+  Store time: microseconds of uptime accumulated across resets. Each boot
+  continues from the newest record found at mount, so timestamps never go
+  backwards within the store.
+  */
+  uint64_t timestampMicroseconds;
+  const char * buf;
+  uint16_t numBytes;
+
+}FS_LogStore_Record_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+void FS_LogStore_InitStructInit(FS_LogStore_InitStruct_t * initStruct);
+
+// Opens the store and recovers the write position. Returns false on failure.
+_Bool FS_LogStore_Init(FS_LogStore_InitStruct_t * initStruct);
+
+// Returns true once FS_LogStore_Init() has succeeded.
+_Bool FS_LogStore_IsMounted(void);
+
+// Appends a record stamped with store time. Thread safe.
+_Bool FS_LogStore_Append(uint64_t uptimeMicroseconds, const char * buf, uint16_t numBytes);
+
+/*
+Calls callback for each record, oldest first, stamped at or after
+sinceMicroseconds (store time). Stops early if the callback returns false.
+Returns the number of records delivered. Thread safe; the store is not locked
+while the callback runs, so it may itself append. Only records already in the
+store when the query starts are delivered. Each record is copied to a
+buffer of FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES on the caller's stack.
+*/
+uint32_t FS_LogStore_Query( uint64_t sinceMicroseconds,
+                            _Bool(*callback)( const FS_LogStore_Record_t * record,
+                                              void * context ),
+                            void * context );
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+#endif // FS_LOGSTORE_H
@@ -1,10 +1,68 @@
 #ifndef FS_LOGGING_H
 #define FS_LOGGING_H
 
+#include <stdint.h>
+
+#include "FS_Console.h"
+
+// Longest single log line; longer lines are truncated.
+#ifndef FS_LOGGING_BUFFER_LENGTH_BYTES
+#define FS_LOGGING_BUFFER_LENGTH_BYTES 128
+#endif
+
+/*
+Lines each core can hold for the writer task. Once a core's queue is full,
+further lines from it still reach the console but are dropped from the store
+(and counted) until the writer catches up.
+*/
+#ifndef FS_LOGGING_QUEUE_LENGTH_RECORDS
+#define FS_LOGGING_QUEUE_LENGTH_RECORDS 8
+#endif
+
+// Ticks the writer task sleeps for when every queue is empty.
+#ifndef FS_LOGGING_WRITER_PERIOD_TICKS
+#define FS_LOGGING_WRITER_PERIOD_TICKS 1
+#endif
+
+#if FS_LOGGING_QUEUE_LENGTH_RECORDS < 1
+#error "FS_Logging: FS_LOGGING_QUEUE_LENGTH_RECORDS must be at least 1"
+#endif
+
 typedef struct
 {
+  /*
+  Never blocks on the store: lines are queued on the calling core and written
+  by the writer task, so logging costs a format and a copy, not a flash write.
+  */
   int(*printf)(const char * fmt, ...);
 
 }FS_Logging_t;
 
+typedef struct
+{
+  // Instance to which this module will be bound.
+  FS_Logging_t * instance;
+
+  // Optional. If set, log lines are copied to the console and 'log' is registered.
+  FS_Console_t * console;
+
+  // Uptime used to stamp records written to FS_LogStore, if it is mounted.
+  volatile uint64_t * timeMicroseconds;
+
+}FS_Logging_InitStruct_t;
+
+typedef struct
+{
+  _Bool success;
+
+  // Appends queued lines to FS_LogStore. Run as its own task; NULL if no store is mounted.
+  void(*writerLoop)(void * params);
+
+}FS_Logging_InitReturnsStruct_t;
+
+void FS_Logging_InitStructInit(FS_Logging_InitStruct_t * initStruct);
+void FS_Logging_InitReturnsStructInit(FS_Logging_InitReturnsStruct_t * returnsStruct);
+void FS_Logging_Init( FS_Logging_InitStruct_t * initStruct,
+                      FS_Logging_InitReturnsStruct_t * returns );
+
 #endif // FS_LOGGING_H
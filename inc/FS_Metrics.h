@@ -0,0 +1,180 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Metrics.h
+ *
+ * @brief Metrics registry and sampled binary telemetry export - header file.
+ *
+ * Wire format. Every frame is:
+ *
+ *   0xA5 | varint payload length | payload
+ *
+ * All integers are unsigned LEB128 varints; signed values are zigzag encoded
+ * first. The first payload byte gives the frame type:
+ *
+ *   'S' schema: varint metric count, then per metric a type byte
+ *       (FS_Metrics_Type_t), a varint name length and the name bytes. A
+ *       histogram is followed by its varint bucket count.
+ *
+ *   'K' key frame / 'D' delta frame: varint sequence number, varint
+ *       timestamp (absolute uptime in a key frame, microseconds since the
+ *       previous frame in a delta frame), then one zigzag varint per value
+ *       slot in schema order - one per gauge or counter, one per histogram
+ *       bucket. Key frames carry the values themselves, delta frames the
+ *       change (modulo 2^32) since the previous frame.
+ *
+ * A schema is always followed by a key frame, and one is sent whenever a
+ * metric is registered after sampling has started, so a decoder can join a
+ * stream at any schema. Sequence numbers count key and delta frames; a delta
+ * frame only applies to the frame numbered one before it.
+ *
+ * A file sink is a ring of fileSizeBytes. It starts with an 8 byte header,
+ * "FSMT" then the little endian offset of the next byte to be written, which
+ * is updated after every sample. The stream runs from that offset to the end
+ * of the file and then on from just after the header; a frame may be split
+ * across the wrap. Size the file to hold several schema intervals, or the
+ * oldest data will have no schema left to decode it with.
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_METRICS_H
+#define FS_METRICS_H
+
+#include <stdint.h>
+
+#include "FS_DT_Conf.h"
+#include "FS_Filesystem.h"
+
+#ifndef FS_METRICS_MAX_NUM_METRICS
+#define FS_METRICS_MAX_NUM_METRICS 32
+#endif
+
+// Histograms use FS_METRICS_HISTOGRAM_NUM_BUCKETS value slots each, so are pooled separately.
+#ifndef FS_METRICS_MAX_NUM_HISTOGRAMS
+#define FS_METRICS_MAX_NUM_HISTOGRAMS 4
+#endif
+
+/*
+Bucket 0 counts observations of 0; bucket n counts [2^(n-1), 2^n). The last
+bucket also takes everything larger.
+*/
+#ifndef FS_METRICS_HISTOGRAM_NUM_BUCKETS
+#define FS_METRICS_HISTOGRAM_NUM_BUCKETS 16
+#endif
+
+// A key frame is sent every this many frames; the rest are delta frames.
+#ifndef FS_METRICS_KEYFRAME_INTERVAL_FRAMES
+#define FS_METRICS_KEYFRAME_INTERVAL_FRAMES 16
+#endif
+
+// The schema is repeated every this many frames for late joining decoders.
+#ifndef FS_METRICS_SCHEMA_INTERVAL_FRAMES
+#define FS_METRICS_SCHEMA_INTERVAL_FRAMES 256
+#endif
+
+#define FS_METRICS_FRAME_SYNC           0xA5
+#define FS_METRICS_FRAME_TYPE_SCHEMA    'S'
+#define FS_METRICS_FRAME_TYPE_KEY       'K'
+#define FS_METRICS_FRAME_TYPE_DELTA     'D'
+
+#define FS_METRICS_FILE_MAGIC           "FSMT"
+#define FS_METRICS_FILE_HEADER_BYTES    8
+
+#if FS_METRICS_MAX_NUM_METRICS < 1 || FS_METRICS_MAX_NUM_METRICS > INT16_MAX
+#error "FS_Metrics: FS_METRICS_MAX_NUM_METRICS must be between 1 and 32767"
+#endif
+
+#if FS_METRICS_HISTOGRAM_NUM_BUCKETS < 2 || FS_METRICS_HISTOGRAM_NUM_BUCKETS > 33
+#error "FS_Metrics: FS_METRICS_HISTOGRAM_NUM_BUCKETS must be between 2 and 33"
+#endif
+
+#if FS_METRICS_KEYFRAME_INTERVAL_FRAMES < 1 || FS_METRICS_SCHEMA_INTERVAL_FRAMES < 1
+#error "FS_Metrics: frame intervals must be at least 1"
+#endif
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef enum
+{
+  FS_Metrics_Gauge      = 0, // Signed instantaneous value; set().
+  FS_Metrics_Counter    = 1, // Unsigned running total; add().
+  FS_Metrics_Histogram  = 2  // Log2 bucketed distribution; observe().
+
+}FS_Metrics_Type_t;
+
+typedef struct
+{
+  /*
+  Returns a handle for the other calls, or -1 if the registry is full. The
+  name must stay valid for the life of the system.
+  */
+  int16_t(*registerMetric)(const char * name, FS_Metrics_Type_t type);
+
+  // All three are safe to call from any task or ISR; none of them block.
+  void(*set)(int16_t handle, int32_t value);
+  void(*add)(int16_t handle, uint32_t delta);
+  void(*observe)(int16_t handle, uint32_t value);
+
+}FS_Metrics_t;
+
+typedef struct
+{
+  // Instance to which this module will be bound.
+  FS_Metrics_t * instance;
+
+  volatile uint64_t * timeMicroseconds;
+
+  /*
+  Optional free running microsecond clock (e.g. a cycle counter) used to time
+  sampling for fs.metrics.sampleMicroseconds. If NULL, timeMicroseconds is
+  used, which only has the resolution of the timer tick.
+  */
+  uint64_t(*getTimeMicroseconds)(void);
+
+  // Sink - either an IO stream, or a file on fs. Without one, sampling is off.
+  FS_DT_IOStream_t * io;
+  FS_Filesystem_t * fs;
+  const char * path;
+
+  // Size the file is kept within; it is written as a ring (see above).
+  uint32_t fileSizeBytes;
+
+  // Sampling period, in calls to the returned tick function.
+  uint16_t samplePeriodTicks;
+
+}FS_Metrics_InitStruct_t;
+
+typedef struct
+{
+  _Bool success;
+
+  // Samples and streams all metrics each period. Run as its own task; NULL without a sink.
+  void(*samplerLoop)(void * params);
+
+  // Must be called from the system timer tick. Safe to call from an ISR.
+  void(*tick)(void);
+
+}FS_Metrics_InitReturnsStruct_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Metrics_InitStructInit(FS_Metrics_InitStruct_t * initStruct);
+void FS_Metrics_InitReturnsStructInit(FS_Metrics_InitReturnsStruct_t * returnsStruct);
+void FS_Metrics_Init( FS_Metrics_InitStruct_t * initStruct,
+                      FS_Metrics_InitReturnsStruct_t * returns );
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+#endif // FS_METRICS_H
@@ -0,0 +1,127 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Supervisor.h
+ *
+ * @brief Task heartbeat supervisor - header file.
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_SUPERVISOR_H
+#define FS_SUPERVISOR_H
+
+#include <stdint.h>
+
+#include "fs_exception.h"
+
+// Maximum number of tasks which may register a heartbeat.
+#ifndef FS_SUPERVISOR_MAX_NUM_TASKS
+#define FS_SUPERVISOR_MAX_NUM_TASKS 8
+#endif
+
+/*
+A task is reported with raiseWarning() once its heartbeat is overdue, and with
+raiseFatal() once it is overdue by this many deadlines.
+*/
+#ifndef FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER
+#define FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER 4
+#endif
+
+/*
+Kick interval histogram buckets. Bucket n counts intervals between a task's
+kicks of [2^n, 2^(n+1)) us. This is how often the task reports progress, not
+how late it was scheduled.
+*/
+#define FS_SUPERVISOR_NUM_HISTOGRAM_BUCKETS 32
+
+#if FS_SUPERVISOR_MAX_NUM_TASKS < 1 || FS_SUPERVISOR_MAX_NUM_TASKS > INT16_MAX
+#error "FS_Supervisor: FS_SUPERVISOR_MAX_NUM_TASKS must be between 1 and 32767"
+#endif
+
+#if FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER < 1
+#error "FS_Supervisor: FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER must be at least 1"
+#endif
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  /*
+  Returns a handle to pass to kick(), or -1 if the task table is full. The
+  deadline is the longest the task may go between kicks; it is measured in
+  uptime microseconds so must be under ~35 minutes. Thread safe.
+  */
+  int16_t(*registerTask)(const char * name, uint32_t deadlineMicroseconds);
+
+  // Called by the registered task to show it is still making progress.
+  void(*kick)(int16_t handle);
+
+}FS_Supervisor_t;
+
+typedef struct
+{
+  // Instance to which this module will be bound.
+  FS_Supervisor_t * instance;
+
+  // Optional. Without it stalls are only recorded, not raised.
+  FS_Exception_t * exc;
+
+  volatile uint64_t * timeMicroseconds;
+
+}FS_Supervisor_InitStruct_t;
+
+typedef struct
+{
+  _Bool success;
+
+  /*
+  Raises warnings and fatal errors for the tasks tick() flags. Run as its own
+  task, at a higher priority than any supervised task so that a wedged task
+  cannot starve it.
+  */
+  void(*mainLoop)(void * params);
+
+  /*
+  Must be called from the system timer tick (FS_System_TimerTick() does this).
+  Safe to call from an ISR; it never calls FS_Exception_t itself.
+  */
+  void(*tick)(void);
+
+}FS_Supervisor_InitReturnsStruct_t;
+
+typedef struct
+{
+  const char * name;
+  uint32_t deadlineMicroseconds;
+  uint32_t overdueMicroseconds; // Time since the last kick when the stall was detected.
+
+}FS_Supervisor_StallRecord_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Supervisor_InitStructInit(FS_Supervisor_InitStruct_t * initStruct);
+void FS_Supervisor_InitReturnsStructInit(FS_Supervisor_InitReturnsStruct_t * returnsStruct);
+void FS_Supervisor_Init( FS_Supervisor_InitStruct_t * initStruct,
+                         FS_Supervisor_InitReturnsStruct_t * returns );
+
+// Returns false if no task has yet been declared fatally stalled.
+_Bool FS_Supervisor_GetLastFatalStall(FS_Supervisor_StallRecord_t * record);
+
+// Prints each task's heartbeat state and kick interval histogram.
+void FS_Supervisor_PrintReport(int(*printfFn)(const char * fmt, ...));
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+#endif // FS_SUPERVISOR_H
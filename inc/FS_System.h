@@ -3,10 +3,12 @@
 
 #include <stdio.h>
 
-#include "FS_Exception.h"
+#include "fs_exception.h"
 #include "FS_Filesystem.h"
 #include "FS_Console.h"
 #include "FS_Logging.h"
+#include "FS_Supervisor.h"
+#include "FS_Metrics.h"
 
 
 #include <stdint.h>
@@ -16,12 +18,14 @@
 typedef struct
 {
   _Bool isInitialised; // If flag set, it's safe to use the system binding.
-  volatile uint64_t timeMicroseconds; // Application, not FS_System, must increment this.
+  volatile uint64_t timeMicroseconds; // Advanced by FS_System_TimerTick().
 
   FS_Exception_t * exc;
   FS_Filesystem_t * fs;
   FS_Console_t * console;
   FS_Logging_t * log;
+  FS_Supervisor_t * supervisor;
+  FS_Metrics_t * metrics;
 
 }FS_GenericModuleSystemBinding_t;
 
@@ -31,12 +35,69 @@ typedef struct
   FS_GenericModuleSystemBinding_t * sysInstance;
   FS_DT_IOStream_t * usart;
 
+  /*
+  Optional free running microsecond clock (e.g. a cycle counter) used to time
+  the init steps. If NULL, timeMicroseconds is used, which only has a
+  resolution of timerIntervalMicroseconds.
+  */
+  uint64_t(*getTimeMicroseconds)(void);
+
+  /*
+  Optional persistent log store, held in a file on sysInstance->fs. Leave
+  logStorePath NULL to log to the console only.
+  */
+  const char * logStorePath;
+  uint32_t logStoreSizeBytes;
+  uint32_t logStoreSectorSizeBytes;
+
+  /*
+  Optional telemetry sink - an IO stream, or a file on sysInstance->fs. The
+  file is kept within metricsFileSizeBytes (0 selects the FS_Metrics default).
+  The sample period is in timer ticks; 0 selects roughly one second, or as
+  close as a uint16_t count of very short ticks allows.
+  */
+  FS_DT_IOStream_t * metricsIO;
+  const char * metricsPath;
+  uint32_t metricsFileSizeBytes;
+  uint16_t metricsSamplePeriodTicks;
 
 }FS_System_InitStruct_t;
 
+typedef enum
+{
+  FS_System_InitStepNotRun  = 0,
+  FS_System_InitStepOk      = 1,
+  FS_System_InitStepFailed  = 2,
+  FS_System_InitStepSkipped = 3 // A dependency failed or was skipped.
+
+}FS_System_InitStepStatus_t;
+
+// One entry of the boot timeline, in the order the steps were run.
+typedef struct
+{
+  const char * name;
+  FS_System_InitStepStatus_t status;
+  uint64_t startMicroseconds;
+  uint32_t durationMicroseconds;
+
+}FS_System_InitStepRecord_t;
+
 
 void FS_System_InitStructInit(FS_System_InitStruct_t * initStruct);
+
+// Returns true only if every subsystem initialised successfully.
 _Bool FS_System_Init(FS_System_InitStruct_t * initStruct);
 
+/*
+Application must call this from its timer interrupt every
+timerIntervalMicroseconds. Advances timeMicroseconds and runs the supervisor's
+heartbeat checks.
+*/
+void FS_System_TimerTick(void);
+
+// Returns the number of records written to *records.
+uint8_t FS_System_GetBootTimeline(const FS_System_InitStepRecord_t ** records);
+void FS_System_PrintBootTimeline(int(*printfFn)(const char * fmt, ...));
+
 
 #endif // FS_SYSTEM_H
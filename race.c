@@ -0,0 +1,17 @@
+#include "test_common.h"
+#include "fs_console.c"
+#include <pthread.h>
+#include <unistd.h>
+extern int slowGive;
+static volatile int bRemoved;
+static uint32_t nr(char*b,uint32_t n){return 0;}
+static uint32_t wb(const char*b,uint32_t n){ if(bRemoved) printf("LATE write to removed stream B: %.40s\n", b); return n;}
+static uint32_t wo(const char*b,uint32_t n){return n;}
+static FS_DT_IOStream_t A={nr,wo}, B={nr,wb}, C={nr,wo};
+static FS_Console_InitReturnsStruct_t r;
+static void* adder(void*x){ slowGive=1; r.addIOStreamCallback(&C); return 0;}
+int main(void){ FS_Console_t con; FS_Console_InitStruct_t in; FS_Console_InitStructInit(&in); FS_Console_InitReturnsStructInit(&r);
+ in.instance=&con; in.io=&A; FS_Console_Init(&in,&r); r.addIOStreamCallback(&B);
+ pthread_t t; pthread_create(&t,0,adder,0); usleep(50000);
+ r.removeIOStreamCallback(&B); bRemoved=1; puts("remove(B) returned");
+ pthread_join(t,0); return 0;}
@@ -0,0 +1,113 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Filesystem_Stdio.c
+ *
+ * @brief FS_Filesystem_t binding onto C stdio, for host builds. Lets modules
+ *        such as FS_LogStore run against an ordinary file.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_Filesystem_Stdio.h"
+
+// C standard library includes.
+#include <stdio.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static void * stdioOpen(const char * path);
+static void stdioClose(void * file);
+static _Bool stdioRead(void * file, uint32_t offset, void * buf, uint32_t numBytes);
+static _Bool stdioWrite(void * file, uint32_t offset, const void * buf, uint32_t numBytes);
+static _Bool stdioSync(void * file);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Filesystem_StdioInit(FS_Filesystem_t * instance)
+{
+  instance->open = stdioOpen;
+  instance->close = stdioClose;
+  instance->read = stdioRead;
+  instance->write = stdioWrite;
+  instance->sync = stdioSync;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+static void * stdioOpen(const char * path)
+{
+  FILE * file;
+
+  // Open an existing file without truncating it, otherwise create it.
+  file = fopen(path, "r+b");
+
+  if(!file)
+  {
+    file = fopen(path, "w+b");
+  }
+
+  return file;
+}
+
+static void stdioClose(void * file)
+{
+  fclose( (FILE *)file );
+}
+
+static _Bool stdioRead(void * file, uint32_t offset, void * buf, uint32_t numBytes)
+{
+  if( fseek( (FILE *)file, (long)offset, SEEK_SET ) )
+  {
+    return false;
+  }
+
+  // Reading past the end of the file fails, which callers treat as blank media.
+  return ( fread( buf, 1, numBytes, (FILE *)file ) == numBytes );
+}
+
+static _Bool stdioWrite(void * file, uint32_t offset, const void * buf, uint32_t numBytes)
+{
+  if( fseek( (FILE *)file, (long)offset, SEEK_SET ) )
+  {
+    return false;
+  }
+
+  return ( fwrite( buf, 1, numBytes, (FILE *)file ) == numBytes );
+}
+
+static _Bool stdioSync(void * file)
+{
+  return ( 0 == fflush( (FILE *)file ) );
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -0,0 +1,587 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_LogStore.c
+ *
+ * @brief Persistent circular log record store for use with FreeRTOS.
+ *
+ * The store is a fixed size file split in to equal sectors which are filled in
+ * turn and reused round robin once the store is full, so wear is spread evenly
+ * over the medium. Each sector starts with a header carrying a sequence number
+ * and the timestamp of its first record. Every record carries its sector's
+ * sequence number and a CRC, so after a reset the write position is recovered
+ * by finding the newest sector and walking its records until the first one
+ * which does not check out - a record torn by a crash, or a stale record from
+ * the sector's previous pass.
+ *
+ * Because sectors are filled in timestamp order, the sector headers double as
+ * a sparse time index: a time range query binary searches them to find the
+ * first sector of interest and only scans records from there on.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_LogStore.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// FreeRTOS includes.
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINES ---------------------------------
+------------------------------------------------------------------------------*/
+
+#define SECTOR_MAGIC 0x534C5346UL // "FSLS"
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINES ----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  uint64_t firstTimestampMicroseconds;
+  uint32_t magic;
+  uint32_t seq;
+  uint16_t crc;
+  uint16_t reserved0;
+  uint32_t reserved1;
+
+}SectorHeader_t;
+
+typedef struct
+{
+  uint64_t timestampMicroseconds;
+  uint32_t sectorSeq; // Must match the sector header or the record is stale.
+  uint16_t length;
+  uint16_t crc; // Covers this header (with crc zeroed) and the payload.
+
+}RecordHeader_t;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static uint16_t crc16(uint16_t crc, const void * data, uint32_t numBytes);
+static _Bool readSectorHeader(uint32_t sector, SectorHeader_t * header);
+static _Bool readRecord( uint32_t sector, uint32_t seq, uint32_t offset,
+                         RecordHeader_t * header, char * payload );
+static _Bool openNextSector(uint64_t timestampMicroseconds);
+static uint32_t logicalToPhysicalSector(uint32_t logicalSector);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE GLOBAL VARIABLES ---------------------------
+------------------------------------------------------------------------------*/
+
+static FS_Filesystem_t * fs;
+static void * file;
+static SemaphoreHandle_t mutex;
+static _Bool mounted;
+
+static uint32_t sectorSizeBytes;
+static uint32_t numSectors;
+
+static uint32_t headSector;      // Physical index of the sector being written.
+static uint32_t headSeq;         // Its sequence number.
+static uint32_t writeOffset;     // Next free byte within the head sector.
+static uint32_t numValidSectors; // Consecutive sectors ending at the head.
+
+static uint64_t bootBaseMicroseconds;
+static uint64_t lastTimestampMicroseconds;
+
+// Scratch space for one record while appending or mounting. Only used with the mutex held.
+static char recordBuffer[sizeof(RecordHeader_t) + FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES];
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_LogStore_InitStructInit(FS_LogStore_InitStruct_t * initStruct)
+{
+  initStruct->fs = NULL;
+  initStruct->path = NULL;
+  initStruct->sizeBytes = 0;
+  initStruct->sectorSizeBytes = 4096;
+}
+
+_Bool FS_LogStore_Init(FS_LogStore_InitStruct_t * initStruct)
+{
+  uint32_t sector, k;
+  SectorHeader_t header, newest;
+  RecordHeader_t record;
+  _Bool found;
+
+  mounted = false;
+
+  fs = initStruct->fs;
+  sectorSizeBytes = initStruct->sectorSizeBytes;
+  numSectors = sectorSizeBytes ? ( initStruct->sizeBytes / sectorSizeBytes ) : 0;
+
+  // Need at least two sectors so one can be reused while the other is kept.
+  if( !fs || !initStruct->path || ( numSectors < 2 ) ||
+      ( sectorSizeBytes < sizeof(SectorHeader_t) + sizeof(RecordHeader_t) + 1 ) )
+  {
+    return false;
+  }
+
+  if(!mutex)
+  {
+    mutex = xSemaphoreCreateMutex();
+
+    if(!mutex)
+    {
+      return false;
+    }
+  }
+
+  file = fs->open(initStruct->path);
+
+  if(!file)
+  {
+    return false;
+  }
+
+  // Find the newest sector.
+  found = false;
+  memset(&newest, 0, sizeof(newest));
+
+  for(sector = 0; sector < numSectors; sector++)
+  {
+    if( readSectorHeader(sector, &header) && ( !found || ( header.seq > newest.seq ) ) )
+    {
+      found = true;
+      newest = header;
+      headSector = sector;
+    }
+  }
+
+  // Blank store - the first append will open sector 0.
+  if(!found)
+  {
+    headSector = numSectors - 1;
+    headSeq = 0;
+    writeOffset = sectorSizeBytes;
+    numValidSectors = 0;
+    lastTimestampMicroseconds = 0;
+  }
+
+  else
+  {
+    headSeq = newest.seq;
+
+    // Count back over the run of sectors with consecutive sequence numbers.
+    for(k = 1; k < numSectors; k++)
+    {
+      sector = ( headSector + numSectors - k ) % numSectors;
+
+      if( !readSectorHeader(sector, &header) || ( header.seq != headSeq - k ) )
+      {
+        break;
+      }
+    }
+
+    numValidSectors = k;
+
+    // Walk the head sector's records to recover the write position.
+    writeOffset = sizeof(SectorHeader_t);
+    lastTimestampMicroseconds = newest.firstTimestampMicroseconds;
+
+    while( readRecord( headSector, headSeq, writeOffset, &record,
+                       &recordBuffer[sizeof(RecordHeader_t)] ) )
+    {
+      lastTimestampMicroseconds = record.timestampMicroseconds;
+      writeOffset += sizeof(RecordHeader_t) + record.length;
+    }
+  }
+
+  // Carry on from where the previous boot left off.
+  bootBaseMicroseconds = lastTimestampMicroseconds;
+
+  mounted = true;
+
+  return true;
+}
+
+_Bool FS_LogStore_IsMounted(void)
+{
+  return mounted;
+}
+
+_Bool FS_LogStore_Append(uint64_t uptimeMicroseconds, const char * buf, uint16_t numBytes)
+{
+  RecordHeader_t header;
+  uint64_t timestamp;
+  uint32_t maxLength;
+  _Bool retVal;
+
+  if(!mounted)
+  {
+    return false;
+  }
+
+  maxLength = sectorSizeBytes - sizeof(SectorHeader_t) - sizeof(RecordHeader_t);
+
+  if(numBytes > FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES)
+  {
+    numBytes = FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES;
+  }
+
+  if(numBytes > maxLength)
+  {
+    numBytes = maxLength;
+  }
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+
+  // Keep store time monotonic; the time index relies on it.
+  timestamp = bootBaseMicroseconds + uptimeMicroseconds;
+
+  if(timestamp < lastTimestampMicroseconds)
+  {
+    timestamp = lastTimestampMicroseconds;
+  }
+
+  retVal = true;
+
+  if( writeOffset + sizeof(RecordHeader_t) + numBytes > sectorSizeBytes )
+  {
+    retVal = openNextSector(timestamp);
+  }
+
+  if(retVal)
+  {
+    header.timestampMicroseconds = timestamp;
+    header.sectorSeq = headSeq;
+    header.length = numBytes;
+    header.crc = 0;
+    header.crc = crc16( crc16(0xFFFF, &header, sizeof(header)), buf, numBytes );
+
+    // Header and payload go down in one write so a torn record fails its CRC.
+    memcpy(recordBuffer, &header, sizeof(header));
+    memcpy(&recordBuffer[sizeof(header)], buf, numBytes);
+
+    retVal = fs->write( file,
+                        headSector * sectorSizeBytes + writeOffset,
+                        recordBuffer,
+                        sizeof(header) + numBytes )
+             && fs->sync(file);
+
+    lastTimestampMicroseconds = timestamp;
+
+    if(retVal)
+    {
+      writeOffset += sizeof(header) + numBytes;
+    }
+
+    /*
+    The record may be partly written. Readers stop at the first record which
+    fails its check, so anything appended after it in this sector would be
+    lost; abandon the rest of the sector instead.
+    */
+    else
+    {
+      openNextSector(timestamp);
+    }
+  }
+
+  xSemaphoreGive(mutex);
+
+  return retVal;
+}
+
+uint32_t FS_LogStore_Query( uint64_t sinceMicroseconds,
+                            _Bool(*callback)( const FS_LogStore_Record_t * record,
+                                              void * context ),
+                            void * context )
+{
+  uint32_t lo, hi, mid, sector, seq, oldestSeq, offset, numDelivered;
+  uint32_t endSeq, endOffset;
+  SectorHeader_t sectorHeader;
+  RecordHeader_t recordHeader;
+  FS_LogStore_Record_t record;
+  char payload[FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES];
+  _Bool found, keepGoing;
+
+  if(!mounted)
+  {
+    return 0;
+  }
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+
+  if(!numValidSectors)
+  {
+    xSemaphoreGive(mutex);
+    return 0;
+  }
+
+  /*
+  Binary search the sector headers for the last sector whose first record is
+  no later than sinceMicroseconds. Every record before that sector is older.
+  */
+  mid = 0;
+  lo = 0;
+  hi = numValidSectors;
+
+  while(lo < hi)
+  {
+    mid = lo + ( hi - lo ) / 2;
+
+    if( readSectorHeader( logicalToPhysicalSector(mid), &sectorHeader ) &&
+        ( sectorHeader.firstTimestampMicroseconds <= sinceMicroseconds ) )
+    {
+      lo = mid + 1;
+    }
+
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  mid = lo ? ( lo - 1 ) : 0;
+  sector = logicalToPhysicalSector(mid);
+  seq = headSeq - ( numValidSectors - 1 ) + mid;
+  offset = sizeof(SectorHeader_t);
+
+  // Records appended after this point are not delivered, or a busy store would never let go.
+  endSeq = headSeq;
+  endOffset = writeOffset;
+
+  xSemaphoreGive(mutex);
+
+  /*
+  Records are read one at a time with the mutex held and delivered with it
+  released, so a slow callback (e.g. writing to a console) never holds up
+  appends. Appends may therefore move the head on, and even reuse sectors,
+  between records; the position is kept as a sector and its sequence number
+  and checked against the store each time.
+  */
+  numDelivered = 0;
+  keepGoing = true;
+
+  while(keepGoing)
+  {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
+    // The sector was reused under us; carry on from the oldest one left.
+    oldestSeq = headSeq - ( numValidSectors - 1 );
+
+    if(seq < oldestSeq)
+    {
+      sector = logicalToPhysicalSector(0);
+      seq = oldestSeq;
+      offset = sizeof(SectorHeader_t);
+    }
+
+    // Stop at the head as it was when the query started (or once it has been overwritten).
+    found = ( ( seq < endSeq ) || ( ( seq == endSeq ) && ( offset < endOffset ) ) ) &&
+            readRecord(sector, seq, offset, &recordHeader, payload);
+
+    if(found)
+    {
+      offset += sizeof(RecordHeader_t) + recordHeader.length;
+    }
+
+    // No more records in this sector. Move on unless it is the end.
+    else if(seq < endSeq)
+    {
+      sector = ( sector + 1 ) % numSectors;
+      seq++;
+      offset = sizeof(SectorHeader_t);
+    }
+
+    else
+    {
+      keepGoing = false;
+    }
+
+    xSemaphoreGive(mutex);
+
+    if( found && ( recordHeader.timestampMicroseconds >= sinceMicroseconds ) )
+    {
+      record.timestampMicroseconds = recordHeader.timestampMicroseconds;
+      record.buf = payload;
+      record.numBytes = recordHeader.length;
+
+      keepGoing = callback(&record, context);
+      numDelivered++;
+    }
+  }
+
+  return numDelivered;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+// CRC-16/CCITT-FALSE, bitwise to keep it small.
+static uint16_t crc16(uint16_t crc, const void * data, uint32_t numBytes)
+{
+  const uint8_t * bytes = data;
+  uint8_t bit;
+
+  while(numBytes--)
+  {
+    crc ^= (uint16_t)( *bytes++ ) << 8;
+
+    for(bit = 0; bit < 8; bit++)
+    {
+      crc = ( crc & 0x8000 ) ? (uint16_t)( ( crc << 1 ) ^ 0x1021 ) : (uint16_t)( crc << 1 );
+    }
+  }
+
+  return crc;
+}
+
+static _Bool readSectorHeader(uint32_t sector, SectorHeader_t * header)
+{
+  uint16_t crc;
+
+  if( !fs->read( file, sector * sectorSizeBytes, header, sizeof(SectorHeader_t) ) )
+  {
+    return false;
+  }
+
+  crc = header->crc;
+  header->crc = 0;
+
+  if( ( SECTOR_MAGIC != header->magic ) || ( crc16(0xFFFF, header, sizeof(SectorHeader_t)) != crc ) )
+  {
+    return false;
+  }
+
+  header->crc = crc;
+
+  return true;
+}
+
+/*
+Reads the record at offset within sector, copying its payload to payload
+(FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES long). Returns false if there is no valid
+record there, which marks the end of the sector's records.
+*/
+static _Bool readRecord( uint32_t sector, uint32_t seq, uint32_t offset,
+                         RecordHeader_t * header, char * payload )
+{
+  uint16_t crc;
+  uint32_t base;
+
+  if( offset + sizeof(RecordHeader_t) > sectorSizeBytes )
+  {
+    return false;
+  }
+
+  base = sector * sectorSizeBytes + offset;
+
+  if( !fs->read(file, base, header, sizeof(RecordHeader_t)) ||
+      ( header->sectorSeq != seq ) ||
+      ( header->length > FS_LOGSTORE_MAX_RECORD_LENGTH_BYTES ) ||
+      ( offset + sizeof(RecordHeader_t) + header->length > sectorSizeBytes ) )
+  {
+    return false;
+  }
+
+  if( !fs->read(file, base + sizeof(RecordHeader_t), payload, header->length) )
+  {
+    return false;
+  }
+
+  crc = header->crc;
+  header->crc = 0;
+
+  if( crc16( crc16(0xFFFF, header, sizeof(RecordHeader_t)), payload, header->length ) != crc )
+  {
+    return false;
+  }
+
+  header->crc = crc;
+
+  return true;
+}
+
+/*
+Moves the head on to the next sector, reclaiming the oldest once the store is
+full. If the sector header cannot be written the head stays where it was,
+marked full, so that the next append tries again.
+*/
+static _Bool openNextSector(uint64_t timestampMicroseconds)
+{
+  SectorHeader_t header;
+  uint32_t nextSector;
+
+  nextSector = ( headSector + 1 ) % numSectors;
+
+  memset(&header, 0, sizeof(header));
+  header.firstTimestampMicroseconds = timestampMicroseconds;
+  header.magic = SECTOR_MAGIC;
+  header.seq = headSeq + 1;
+  header.crc = crc16(0xFFFF, &header, sizeof(header));
+
+  if( !fs->write(file, nextSector * sectorSizeBytes, &header, sizeof(header)) )
+  {
+    writeOffset = sectorSizeBytes;
+    return false;
+  }
+
+  headSector = nextSector;
+  headSeq++;
+  writeOffset = sizeof(SectorHeader_t);
+
+  if(numValidSectors < numSectors)
+  {
+    numValidSectors++;
+  }
+
+  return true;
+}
+
+// Logical sector 0 is the oldest still held in the store.
+static uint32_t logicalToPhysicalSector(uint32_t logicalSector)
+{
+  return ( headSector + numSectors - ( numValidSectors - 1 ) + logicalSector ) % numSectors;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
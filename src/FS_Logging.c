@@ -0,0 +1,368 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Logging.c
+ *
+ * @brief System log. Lines go to FS_LogStore, when mounted, so they survive a
+ *        reset, and are copied to the console. Store writes are made by a
+ *        single writer task, never by the logging task.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_Logging.h"
+
+// FirmwareSavvy library includes.
+#include "FS_LogStore.h"
+
+// C standard library includes.
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+// FreeRTOS includes.
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINES ---------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Each core queues its lines separately, as the console does its printf output,
+so that logging tasks on different cores never contend with each other or
+wait on the store.
+*/
+#ifndef FS_LOGGING_NUM_CORES
+  #ifdef configNUMBER_OF_CORES
+    #define FS_LOGGING_NUM_CORES configNUMBER_OF_CORES
+  #else
+    #define FS_LOGGING_NUM_CORES 1
+  #endif
+#endif
+
+#if FS_LOGGING_NUM_CORES > 1
+  #define FS_LOGGING_GET_CORE_ID() portGET_CORE_ID()
+#else
+  #define FS_LOGGING_GET_CORE_ID() 0
+#endif
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINES ----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  uint64_t timestampMicroseconds;
+  uint16_t length;
+  char buf[FS_LOGGING_BUFFER_LENGTH_BYTES];
+
+}QueuedRecord_t;
+
+/*
+Single producer (whichever task is running on the owning core, with that
+core's interrupts masked) / single consumer (the writer task) record queue.
+head and tail run freely; their difference is the number of queued records.
+*/
+typedef struct
+{
+  QueuedRecord_t records[FS_LOGGING_QUEUE_LENGTH_RECORDS];
+  atomic_uint head; // Written by the producer only.
+  atomic_uint tail; // Written by the writer task only.
+  atomic_uint droppedRecords;
+
+}CoreQueue_t;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static int logPrintf(const char * fmt, ...);
+static void queueRecord(const char * buf, uint16_t length);
+static _Bool writeOldestRecord(void);
+static void writerLoop(void * params);
+static void logCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console);
+static _Bool showRecord(const FS_LogStore_Record_t * record, void * context);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE GLOBAL VARIABLES ---------------------------
+------------------------------------------------------------------------------*/
+
+static FS_Console_t * console;
+static volatile uint64_t * timeMicroseconds;
+static _Bool storing;
+static CoreQueue_t coreQueues[FS_LOGGING_NUM_CORES];
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Logging_InitStructInit(FS_Logging_InitStruct_t * initStruct)
+{
+  initStruct->instance = NULL;
+  initStruct->console = NULL;
+  initStruct->timeMicroseconds = NULL;
+}
+
+void FS_Logging_InitReturnsStructInit(FS_Logging_InitReturnsStruct_t * returnsStruct)
+{
+  returnsStruct->success = false;
+  returnsStruct->writerLoop = NULL;
+}
+
+void FS_Logging_Init( FS_Logging_InitStruct_t * initStruct,
+                      FS_Logging_InitReturnsStruct_t * returns )
+{
+  returns->success = false;
+
+  if( !initStruct->instance || !initStruct->timeMicroseconds )
+  {
+    return;
+  }
+
+  console = initStruct->console;
+  timeMicroseconds = initStruct->timeMicroseconds;
+
+  // Lines are only queued for the store if there is one to write them to.
+  storing = FS_LogStore_IsMounted();
+
+  // Bind the instance to the implementation.
+  initStruct->instance->printf = logPrintf;
+
+  if( console && !console->registerCommand( "log",
+                                            logCommand,
+                                            "log show [--since <seconds>] - prints stored log records." ) )
+  {
+    return;
+  }
+
+  // Populate the returns struct.
+  returns->writerLoop = storing ? writerLoop : NULL;
+  returns->success = true;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+static int logPrintf(const char * fmt, ...)
+{
+  va_list arg;
+  int bytes;
+  char logBuffer[FS_LOGGING_BUFFER_LENGTH_BYTES];
+
+  va_start(arg, fmt);
+  bytes = vsnprintf(logBuffer, FS_LOGGING_BUFFER_LENGTH_BYTES, fmt, arg);
+  va_end(arg);
+
+  if(storing)
+  {
+    queueRecord(logBuffer, (uint16_t)strlen(logBuffer));
+  }
+
+  if(console)
+  {
+    console->printf("%s", logBuffer);
+  }
+
+  return bytes;
+}
+
+static void queueRecord(const char * buf, uint16_t length)
+{
+  UBaseType_t savedInterruptMask;
+  CoreQueue_t * queue;
+  QueuedRecord_t * record;
+  unsigned int head;
+
+  // Stops the task being preempted or migrated until the record is published.
+  savedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+  queue = &coreQueues[FS_LOGGING_GET_CORE_ID()];
+  head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+  if( head - atomic_load_explicit(&queue->tail, memory_order_acquire) >= FS_LOGGING_QUEUE_LENGTH_RECORDS )
+  {
+    atomic_fetch_add_explicit(&queue->droppedRecords, 1, memory_order_relaxed);
+  }
+
+  else
+  {
+    // Stamped here rather than when formatted, so that each queue stays in time order.
+    record = &queue->records[head % FS_LOGGING_QUEUE_LENGTH_RECORDS];
+    record->timestampMicroseconds = *timeMicroseconds;
+    record->length = length;
+    memcpy(record->buf, buf, length);
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  }
+
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(savedInterruptMask);
+}
+
+/*
+Appends the oldest queued record across all cores, and notes any lines which
+were dropped. Returns true if anything was written.
+*/
+static _Bool writeOldestRecord(void)
+{
+  uint8_t core;
+  unsigned int tail;
+  unsigned int dropped;
+  CoreQueue_t * oldest;
+  QueuedRecord_t * record;
+  QueuedRecord_t * oldestRecord;
+  char droppedMsg[48];
+  int length;
+
+  oldest = NULL;
+  oldestRecord = NULL;
+
+  for(core = 0; core < FS_LOGGING_NUM_CORES; core++)
+  {
+    tail = atomic_load_explicit(&coreQueues[core].tail, memory_order_relaxed);
+
+    if( tail == atomic_load_explicit(&coreQueues[core].head, memory_order_acquire) )
+    {
+      // The lines were dropped after everything queued, so note them once that is written.
+      dropped = atomic_exchange_explicit(&coreQueues[core].droppedRecords, 0, memory_order_relaxed);
+
+      if(dropped)
+      {
+        length = snprintf(droppedMsg, sizeof(droppedMsg), "[log: %u lines dropped]\r\n", dropped);
+        FS_LogStore_Append(*timeMicroseconds, droppedMsg, (uint16_t)length);
+      }
+
+      continue;
+    }
+
+    record = &coreQueues[core].records[tail % FS_LOGGING_QUEUE_LENGTH_RECORDS];
+
+    if( !oldestRecord || ( record->timestampMicroseconds < oldestRecord->timestampMicroseconds ) )
+    {
+      oldest = &coreQueues[core];
+      oldestRecord = record;
+    }
+  }
+
+  if(!oldest)
+  {
+    return false;
+  }
+
+  FS_LogStore_Append(oldestRecord->timestampMicroseconds, oldestRecord->buf, oldestRecord->length);
+
+  // Hand the slot back to the producer only once the store is done with it.
+  atomic_fetch_add_explicit(&oldest->tail, 1, memory_order_release);
+
+  return true;
+}
+
+static void writerLoop(void * params)
+{
+  while(true)
+  {
+    // Only sleep once every queue has been found empty.
+    if( !writeOldestRecord() )
+    {
+      vTaskDelay(FS_LOGGING_WRITER_PERIOD_TICKS);
+    }
+  }
+}
+
+static void logCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  const char * since;
+  uint64_t sinceMicroseconds;
+  static const char usageMsg[] = "Usage: log show [--since <seconds>]\r\n\n";
+  static const char notMountedMsg[] = "No log store mounted.\r\n\n";
+
+  if( strncmp(argv, "show", 4) )
+  {
+    consoleInterface->output(usageMsg, sizeof(usageMsg) - 1);
+    return;
+  }
+
+  if(!FS_LogStore_IsMounted())
+  {
+    consoleInterface->output(notMountedMsg, sizeof(notMountedMsg) - 1);
+    return;
+  }
+
+  sinceMicroseconds = 0;
+  since = strstr(argv, "--since");
+
+  if(since)
+  {
+    sinceMicroseconds = (uint64_t)strtoul(since + 7, NULL, 10) * 1000000ULL;
+  }
+
+  // The store's time index seeks straight to the first matching record.
+  FS_LogStore_Query(sinceMicroseconds, showRecord, consoleInterface);
+
+  consoleInterface->output("\r\n", sizeof("\r\n") - 1);
+}
+
+static _Bool showRecord(const FS_LogStore_Record_t * record, void * context)
+{
+  FS_Console_CommandCallbackInterface_t * consoleInterface = context;
+  char prefix[32];
+  int length;
+
+  length = snprintf( prefix, sizeof(prefix), "[%6lu.%06lu] ",
+                     (unsigned long)( record->timestampMicroseconds / 1000000ULL ),
+                     (unsigned long)( record->timestampMicroseconds % 1000000ULL ) );
+
+  consoleInterface->output(prefix, length);
+  consoleInterface->output(record->buf, record->numBytes);
+
+  // Log lines usually carry their own line ending.
+  if( !record->numBytes || ( '\n' != record->buf[record->numBytes - 1] ) )
+  {
+    consoleInterface->output("\r\n", sizeof("\r\n") - 1);
+  }
+
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -0,0 +1,612 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Metrics.c
+ *
+ * @brief Metrics registry and sampled binary telemetry export for use with
+ *        FreeRTOS. See FS_Metrics.h for the wire format.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_Metrics.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// FreeRTOS includes.
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINES ---------------------------------
+------------------------------------------------------------------------------*/
+
+// Every gauge and counter takes one value slot, every histogram one per bucket.
+#define MAX_NUM_VALUE_SLOTS ( FS_METRICS_MAX_NUM_METRICS + \
+                              FS_METRICS_MAX_NUM_HISTOGRAMS * ( FS_METRICS_HISTOGRAM_NUM_BUCKETS - 1 ) )
+
+#define ENCODER_CHUNK_LENGTH_BYTES 64
+
+// Offset of the write position within the file header.
+#define FILE_HEADER_OFFSET_INDEX 4
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINES ----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  const char * name;
+  FS_Metrics_Type_t type;
+  uint16_t firstSlot;
+
+}Metric_t;
+
+/*
+Frames are encoded twice: once only counting bytes, to get the length prefix,
+then for real through a small chunk buffer. This avoids holding a whole frame
+(several KB at hundreds of metrics) in RAM.
+*/
+typedef struct
+{
+  _Bool counting;
+  uint32_t length;
+  uint8_t chunk[ENCODER_CHUNK_LENGTH_BYTES];
+  uint8_t used;
+
+}Encoder_t;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static int16_t registerMetric(const char * name, FS_Metrics_Type_t type);
+static void set(int16_t handle, int32_t value);
+static void add(int16_t handle, uint32_t delta);
+static void observe(int16_t handle, uint32_t value);
+static void tick(void);
+static void samplerLoop(void * params);
+static uint16_t numSlotsOf(const Metric_t * metric);
+static void sendFrame(uint8_t frameType, int16_t count, uint16_t numSlots);
+static void encodePayload(Encoder_t * enc, uint8_t frameType, int16_t count, uint16_t numSlots);
+static void encodeByte(Encoder_t * enc, uint8_t byte);
+static void encodeVarint(Encoder_t * enc, uint64_t value);
+static void encodeFlush(Encoder_t * enc);
+static void fileWrite(const uint8_t * buf, uint32_t numBytes);
+static void fileWriteHeader(void);
+static uint64_t sampleClock(void);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE GLOBAL VARIABLES ---------------------------
+------------------------------------------------------------------------------*/
+
+static SemaphoreHandle_t registryMutex;
+static Metric_t metrics[FS_METRICS_MAX_NUM_METRICS];
+static atomic_int numMetrics;
+static uint16_t numSlotsAllocated;
+static uint16_t numHistograms;
+
+// Live values, written by set()/add()/observe() from any context.
+static atomic_uint_least32_t liveValues[MAX_NUM_VALUE_SLOTS];
+
+// Sampler task state.
+static uint32_t sampledValues[MAX_NUM_VALUE_SLOTS];
+static uint32_t previousValues[MAX_NUM_VALUE_SLOTS];
+static volatile uint64_t * timeMicroseconds;
+static uint64_t(*getTimeMicroseconds)(void);
+static uint64_t sampleTimestamp;
+static uint64_t previousSampleTimestamp;
+static uint32_t frameSeq;
+
+static FS_DT_IOStream_t * io;
+static FS_Filesystem_t * fs;
+static void * file;
+static uint32_t fileOffset; // Next byte to write; always in the data area.
+static uint32_t fileSizeBytes;
+
+static TaskHandle_t samplerTask;
+static uint16_t samplePeriodTicks;
+static uint16_t ticksUntilSample;
+
+// Self monitoring, so the cost of telemetry is itself visible.
+static int16_t frameBytesMetric;
+static int16_t sampleMicrosecondsMetric;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Metrics_InitStructInit(FS_Metrics_InitStruct_t * initStruct)
+{
+  initStruct->instance = NULL;
+  initStruct->timeMicroseconds = NULL;
+  initStruct->getTimeMicroseconds = NULL;
+  initStruct->io = NULL;
+  initStruct->fs = NULL;
+  initStruct->path = NULL;
+  initStruct->fileSizeBytes = 1048576;
+  initStruct->samplePeriodTicks = 1000;
+}
+
+void FS_Metrics_InitReturnsStructInit(FS_Metrics_InitReturnsStruct_t * returnsStruct)
+{
+  returnsStruct->success = false;
+  returnsStruct->samplerLoop = NULL;
+  returnsStruct->tick = NULL;
+}
+
+void FS_Metrics_Init( FS_Metrics_InitStruct_t * initStruct,
+                      FS_Metrics_InitReturnsStruct_t * returns )
+{
+  uint8_t header[FS_METRICS_FILE_HEADER_BYTES];
+
+  returns->success = false;
+
+  if( !initStruct->instance || !initStruct->timeMicroseconds || !initStruct->samplePeriodTicks )
+  {
+    return;
+  }
+
+  registryMutex = xSemaphoreCreateMutex();
+
+  if(!registryMutex)
+  {
+    return;
+  }
+
+  // Transfer the pertinent fields from the init struct.
+  timeMicroseconds = initStruct->timeMicroseconds;
+  getTimeMicroseconds = initStruct->getTimeMicroseconds;
+  samplePeriodTicks = initStruct->samplePeriodTicks;
+  ticksUntilSample = samplePeriodTicks;
+  io = initStruct->io;
+  fs = initStruct->fs;
+
+  if( !io && fs && initStruct->path )
+  {
+    fileSizeBytes = initStruct->fileSizeBytes;
+
+    if(fileSizeBytes <= FS_METRICS_FILE_HEADER_BYTES)
+    {
+      return;
+    }
+
+    file = fs->open(initStruct->path);
+
+    if(!file)
+    {
+      return;
+    }
+
+    // Carry on from where the previous boot left off, if the header is intact.
+    fileOffset = FS_METRICS_FILE_HEADER_BYTES;
+
+    if( fs->read(file, 0, header, sizeof(header)) &&
+        !memcmp(header, FS_METRICS_FILE_MAGIC, FILE_HEADER_OFFSET_INDEX) )
+    {
+      fileOffset = (uint32_t)header[4] | ( (uint32_t)header[5] << 8 ) |
+                   ( (uint32_t)header[6] << 16 ) | ( (uint32_t)header[7] << 24 );
+
+      if( ( fileOffset < FS_METRICS_FILE_HEADER_BYTES ) || ( fileOffset >= fileSizeBytes ) )
+      {
+        fileOffset = FS_METRICS_FILE_HEADER_BYTES;
+      }
+    }
+  }
+
+  // Bind the instance to the implementation.
+  initStruct->instance->registerMetric = registerMetric;
+  initStruct->instance->set = set;
+  initStruct->instance->add = add;
+  initStruct->instance->observe = observe;
+
+  frameBytesMetric = registerMetric("fs.metrics.frameBytes", FS_Metrics_Gauge);
+  sampleMicrosecondsMetric = registerMetric("fs.metrics.sampleMicroseconds", FS_Metrics_Gauge);
+
+  // Populate the returns struct. Without a sink there is nothing to sample for.
+  returns->samplerLoop = ( io || file ) ? samplerLoop : NULL;
+  returns->tick = tick;
+  returns->success = true;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+static int16_t registerMetric(const char * name, FS_Metrics_Type_t type)
+{
+  int16_t handle;
+  uint16_t slotsNeeded;
+
+  xSemaphoreTake(registryMutex, portMAX_DELAY);
+
+  handle = atomic_load(&numMetrics);
+  slotsNeeded = ( FS_Metrics_Histogram == type ) ? FS_METRICS_HISTOGRAM_NUM_BUCKETS : 1;
+
+  if( ( handle >= FS_METRICS_MAX_NUM_METRICS ) ||
+      ( ( FS_Metrics_Histogram == type ) && ( numHistograms >= FS_METRICS_MAX_NUM_HISTOGRAMS ) ) )
+  {
+    handle = -1;
+  }
+
+  else
+  {
+    metrics[handle].name = name;
+    metrics[handle].type = type;
+    metrics[handle].firstSlot = numSlotsAllocated;
+
+    numSlotsAllocated += slotsNeeded;
+
+    if(FS_Metrics_Histogram == type)
+    {
+      numHistograms++;
+    }
+
+    // Publish only once the entry is complete; the sampler reads up to numMetrics.
+    atomic_store(&numMetrics, handle + 1);
+  }
+
+  xSemaphoreGive(registryMutex);
+
+  return handle;
+}
+
+static void set(int16_t handle, int32_t value)
+{
+  if( ( handle >= 0 ) && ( handle < atomic_load_explicit(&numMetrics, memory_order_acquire) ) &&
+      ( FS_Metrics_Gauge == metrics[handle].type ) )
+  {
+    atomic_store_explicit( &liveValues[metrics[handle].firstSlot], (uint32_t)value,
+                           memory_order_relaxed );
+  }
+}
+
+static void add(int16_t handle, uint32_t delta)
+{
+  if( ( handle >= 0 ) && ( handle < atomic_load_explicit(&numMetrics, memory_order_acquire) ) &&
+      ( FS_Metrics_Counter == metrics[handle].type ) )
+  {
+    atomic_fetch_add_explicit( &liveValues[metrics[handle].firstSlot], delta,
+                               memory_order_relaxed );
+  }
+}
+
+static void observe(int16_t handle, uint32_t value)
+{
+  uint8_t bucket;
+
+  if( ( handle >= 0 ) && ( handle < atomic_load_explicit(&numMetrics, memory_order_acquire) ) &&
+      ( FS_Metrics_Histogram == metrics[handle].type ) )
+  {
+    // Bucket n holds [2^(n-1), 2^n); the last bucket takes everything larger.
+    bucket = 0;
+
+    while( value && ( bucket < FS_METRICS_HISTOGRAM_NUM_BUCKETS - 1 ) )
+    {
+      value >>= 1;
+      bucket++;
+    }
+
+    atomic_fetch_add_explicit( &liveValues[metrics[handle].firstSlot + bucket], 1,
+                               memory_order_relaxed );
+  }
+}
+
+static void tick(void)
+{
+  BaseType_t higherPriorityTaskWoken;
+
+  if(!samplerTask)
+  {
+    return;
+  }
+
+  if(0 == --ticksUntilSample)
+  {
+    ticksUntilSample = samplePeriodTicks;
+
+    higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(samplerTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+  }
+}
+
+static void samplerLoop(void * params)
+{
+  int16_t count, schemaCount, i;
+  uint16_t numSlots;
+  uint32_t framesSinceKey, framesSinceSchema;
+  uint64_t sampleStart;
+  _Bool key;
+
+  schemaCount = -1;
+  framesSinceKey = 0;
+  framesSinceSchema = 0;
+
+  samplerTask = xTaskGetCurrentTaskHandle();
+
+  while(true)
+  {
+    // Woken by tick() once per sample period.
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    sampleStart = sampleClock();
+    sampleTimestamp = *timeMicroseconds;
+
+    // Snapshot every published metric.
+    count = atomic_load(&numMetrics);
+    numSlots = count ? ( metrics[count - 1].firstSlot + numSlotsOf(&metrics[count - 1]) ) : 0;
+
+    for(i = 0; i < numSlots; i++)
+    {
+      sampledValues[i] = atomic_load_explicit(&liveValues[i], memory_order_relaxed);
+    }
+
+    key = false;
+
+    // A new metric, or time to repeat the schema for late joiners.
+    if( ( count != schemaCount ) || ( framesSinceSchema >= FS_METRICS_SCHEMA_INTERVAL_FRAMES ) )
+    {
+      sendFrame(FS_METRICS_FRAME_TYPE_SCHEMA, count, numSlots);
+      schemaCount = count;
+      framesSinceSchema = 0;
+      key = true;
+    }
+
+    if(framesSinceKey >= FS_METRICS_KEYFRAME_INTERVAL_FRAMES)
+    {
+      key = true;
+    }
+
+    sendFrame(key ? FS_METRICS_FRAME_TYPE_KEY : FS_METRICS_FRAME_TYPE_DELTA, count, numSlots);
+
+    framesSinceKey = key ? 1 : ( framesSinceKey + 1 );
+    framesSinceSchema++;
+    frameSeq++;
+    previousSampleTimestamp = sampleTimestamp;
+    memcpy(previousValues, sampledValues, numSlots * sizeof(uint32_t));
+
+    if(file)
+    {
+      fileWriteHeader();
+      fs->sync(file);
+    }
+
+    set(sampleMicrosecondsMetric, (int32_t)( sampleClock() - sampleStart ));
+  }
+}
+
+static uint16_t numSlotsOf(const Metric_t * metric)
+{
+  return ( FS_Metrics_Histogram == metric->type ) ? FS_METRICS_HISTOGRAM_NUM_BUCKETS : 1;
+}
+
+static void sendFrame(uint8_t frameType, int16_t count, uint16_t numSlots)
+{
+  static Encoder_t enc;
+  uint32_t payloadLength;
+
+  // First pass - measure the payload.
+  enc.counting = true;
+  enc.length = 0;
+  enc.used = 0;
+  encodePayload(&enc, frameType, count, numSlots);
+  payloadLength = enc.length;
+
+  // Second pass - write the frame out.
+  enc.counting = false;
+  enc.length = 0;
+  encodeByte(&enc, FS_METRICS_FRAME_SYNC);
+  encodeVarint(&enc, payloadLength);
+  encodePayload(&enc, frameType, count, numSlots);
+  encodeFlush(&enc);
+
+  set(frameBytesMetric, (int32_t)enc.length);
+}
+
+static void encodePayload(Encoder_t * enc, uint8_t frameType, int16_t count, uint16_t numSlots)
+{
+  int16_t i;
+  uint16_t slot;
+  int32_t value;
+  const char * name;
+
+  encodeByte(enc, frameType);
+
+  if(FS_METRICS_FRAME_TYPE_SCHEMA == frameType)
+  {
+    encodeVarint(enc, count);
+
+    for(i = 0; i < count; i++)
+    {
+      encodeByte(enc, metrics[i].type);
+
+      encodeVarint(enc, strlen(metrics[i].name));
+
+      for(name = metrics[i].name; *name; name++)
+      {
+        encodeByte(enc, *name);
+      }
+
+      if(FS_Metrics_Histogram == metrics[i].type)
+      {
+        encodeVarint(enc, FS_METRICS_HISTOGRAM_NUM_BUCKETS);
+      }
+    }
+
+    return;
+  }
+
+  encodeVarint(enc, frameSeq);
+
+  if(FS_METRICS_FRAME_TYPE_KEY == frameType)
+  {
+    encodeVarint(enc, sampleTimestamp);
+  }
+
+  else
+  {
+    encodeVarint(enc, sampleTimestamp - previousSampleTimestamp);
+  }
+
+  for(slot = 0; slot < numSlots; slot++)
+  {
+    // Differences are taken modulo 2^32 so counters may wrap freely.
+    if(FS_METRICS_FRAME_TYPE_KEY == frameType)
+    {
+      value = (int32_t)sampledValues[slot];
+    }
+
+    else
+    {
+      value = (int32_t)( sampledValues[slot] - previousValues[slot] );
+    }
+
+    // Zigzag, so small negative changes stay short.
+    encodeVarint( enc, ( (uint32_t)value << 1 ) ^ (uint32_t)( value >> 31 ) );
+  }
+}
+
+static void encodeByte(Encoder_t * enc, uint8_t byte)
+{
+  enc->length++;
+
+  if(enc->counting)
+  {
+    return;
+  }
+
+  enc->chunk[enc->used++] = byte;
+
+  if(ENCODER_CHUNK_LENGTH_BYTES == enc->used)
+  {
+    encodeFlush(enc);
+  }
+}
+
+static void encodeVarint(Encoder_t * enc, uint64_t value)
+{
+  while(value >= 0x80)
+  {
+    encodeByte( enc, (uint8_t)( value | 0x80 ) );
+    value >>= 7;
+  }
+
+  encodeByte(enc, (uint8_t)value);
+}
+
+static void encodeFlush(Encoder_t * enc)
+{
+  if(!enc->used)
+  {
+    return;
+  }
+
+  if(io)
+  {
+    io->writeBytes( (const char *)enc->chunk, enc->used );
+  }
+
+  else if(file)
+  {
+    fileWrite(enc->chunk, enc->used);
+  }
+
+  enc->used = 0;
+}
+
+// Writes to the file's data area, wrapping back to just after the header at the end.
+static void fileWrite(const uint8_t * buf, uint32_t numBytes)
+{
+  uint32_t chunk;
+
+  while(numBytes)
+  {
+    chunk = fileSizeBytes - fileOffset;
+
+    if(numBytes < chunk)
+    {
+      chunk = numBytes;
+    }
+
+    // A failed write leaves a gap; the decoder resynchronises on the next sync byte.
+    fs->write(file, fileOffset, buf, chunk);
+
+    buf += chunk;
+    numBytes -= chunk;
+    fileOffset += chunk;
+
+    if(fileOffset >= fileSizeBytes)
+    {
+      fileOffset = FS_METRICS_FILE_HEADER_BYTES;
+    }
+  }
+}
+
+static void fileWriteHeader(void)
+{
+  uint8_t header[FS_METRICS_FILE_HEADER_BYTES];
+
+  memcpy(header, FS_METRICS_FILE_MAGIC, FILE_HEADER_OFFSET_INDEX);
+  header[4] = (uint8_t)fileOffset;
+  header[5] = (uint8_t)( fileOffset >> 8 );
+  header[6] = (uint8_t)( fileOffset >> 16 );
+  header[7] = (uint8_t)( fileOffset >> 24 );
+
+  fs->write(file, 0, header, sizeof(header));
+}
+
+static uint64_t sampleClock(void)
+{
+  // Prefer the application's fine grained clock; fall back to the tick count.
+  if(getTimeMicroseconds)
+  {
+    return getTimeMicroseconds();
+  }
+
+  return *timeMicroseconds;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
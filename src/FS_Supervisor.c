@@ -0,0 +1,417 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_Supervisor.c
+ *
+ * @brief Task heartbeat supervisor for use with FreeRTOS.
+ *
+ * Tasks register a heartbeat deadline and kick the supervisor as they make
+ * progress. The system tick compares each task's last kick against its
+ * deadline; overdue tasks are reported through FS_Exception_t, first as a
+ * warning and then, if the task stays stalled, as a fatal error. The tick only
+ * flags them; the supervisor task, woken by the tick, does the reporting so
+ * that FS_Exception_t is never called from an ISR.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_Supervisor.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// FreeRTOS includes.
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef enum
+{
+  TASK_STATE_OK,
+  TASK_STATE_WARNING_PENDING, // Overdue; the supervisor task will raise the warning.
+  TASK_STATE_WARNED,
+  TASK_STATE_FATAL_PENDING, // Stalled; the supervisor task will raise the fatal error.
+  TASK_STATE_FATAL
+
+}TaskState_t;
+
+typedef struct
+{
+  const char * name;
+  uint32_t deadlineMicroseconds;
+
+  // Low 32 bits of uptime. Differences are taken modulo 2^32.
+  atomic_uint_least32_t lastKickMicroseconds;
+  atomic_uint_least32_t worstIntervalMicroseconds;
+  atomic_uint state;
+
+  /*
+  Intervals between kicks. Not scheduling latency: a task which kicks at every
+  step of its work (as the console does on each output) mostly shows how often
+  it makes progress.
+  */
+  atomic_uint_least32_t histogram[FS_SUPERVISOR_NUM_HISTOGRAM_BUCKETS];
+
+}SupervisedTask_t;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static int16_t registerTask(const char * name, uint32_t deadlineMicroseconds);
+static void kick(int16_t handle);
+static void tick(void);
+static void mainLoop(void * params);
+static uint32_t now(void);
+static uint8_t histogramBucket(uint32_t intervalMicroseconds);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE GLOBAL VARIABLES ---------------------------
+------------------------------------------------------------------------------*/
+
+static FS_Exception_t * exc;
+static int16_t excModuleLabel;
+static volatile uint64_t * timeMicroseconds;
+static TaskHandle_t supervisorTask;
+
+static SemaphoreHandle_t registryMutex;
+static SupervisedTask_t tasks[FS_SUPERVISOR_MAX_NUM_TASKS];
+static atomic_int numTasks;
+
+static FS_Supervisor_StallRecord_t lastFatalStall;
+static atomic_bool fatalStallRecorded;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_Supervisor_InitStructInit(FS_Supervisor_InitStruct_t * initStruct)
+{
+  initStruct->instance = NULL;
+  initStruct->exc = NULL;
+  initStruct->timeMicroseconds = NULL;
+}
+
+void FS_Supervisor_InitReturnsStructInit(FS_Supervisor_InitReturnsStruct_t * returnsStruct)
+{
+  returnsStruct->success = false;
+  returnsStruct->mainLoop = NULL;
+  returnsStruct->tick = NULL;
+}
+
+void FS_Supervisor_Init( FS_Supervisor_InitStruct_t * initStruct,
+                         FS_Supervisor_InitReturnsStruct_t * returns )
+{
+  if( !initStruct->instance || !initStruct->timeMicroseconds )
+  {
+    returns->success = false;
+    return;
+  }
+
+  registryMutex = xSemaphoreCreateMutex();
+
+  if(!registryMutex)
+  {
+    returns->success = false;
+    return;
+  }
+
+  // Transfer the pertinent fields from the init struct.
+  exc = initStruct->exc;
+  timeMicroseconds = initStruct->timeMicroseconds;
+
+  if(exc)
+  {
+    excModuleLabel = exc->registerModule("FS_Supervisor", NULL);
+  }
+
+  // Bind the instance to the implementation.
+  initStruct->instance->registerTask = registerTask;
+  initStruct->instance->kick = kick;
+
+  // Populate the returns struct.
+  returns->mainLoop = mainLoop;
+  returns->tick = tick;
+  returns->success = true;
+}
+
+_Bool FS_Supervisor_GetLastFatalStall(FS_Supervisor_StallRecord_t * record)
+{
+  if( !atomic_load(&fatalStallRecorded) )
+  {
+    return false;
+  }
+
+  *record = lastFatalStall;
+
+  return true;
+}
+
+void FS_Supervisor_PrintReport(int(*printfFn)(const char * fmt, ...))
+{
+  int16_t i, count;
+  uint8_t bucket;
+  uint32_t sinceKick;
+  SupervisedTask_t * task;
+  static const char * stateStrings[] = { "ok", "OVERDUE", "OVERDUE", "STALLED", "STALLED" };
+
+  count = atomic_load(&numTasks);
+
+  for(i = 0; i < count; i++)
+  {
+    task = &tasks[i];
+    sinceKick = now() - atomic_load(&task->lastKickMicroseconds);
+
+    printfFn( "\r\n%s: %s, deadline %lu us, last kick %lu us ago, worst kick interval %lu us\r\n",
+              task->name,
+              stateStrings[atomic_load(&task->state)],
+              (unsigned long)task->deadlineMicroseconds,
+              (unsigned long)sinceKick,
+              (unsigned long)atomic_load(&task->worstIntervalMicroseconds) );
+
+    for(bucket = 0; bucket < FS_SUPERVISOR_NUM_HISTOGRAM_BUCKETS; bucket++)
+    {
+      if( atomic_load(&task->histogram[bucket]) )
+      {
+        printfFn( "  >= %10lu us: %lu\r\n",
+                  1UL << bucket,
+                  (unsigned long)atomic_load(&task->histogram[bucket]) );
+      }
+    }
+  }
+
+  printfFn("\r\n");
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+static int16_t registerTask(const char * name, uint32_t deadlineMicroseconds)
+{
+  int16_t handle;
+  SupervisedTask_t * task;
+
+  // Tasks register as they start, so several may do so at once.
+  xSemaphoreTake(registryMutex, portMAX_DELAY);
+
+  handle = atomic_load(&numTasks);
+
+  if(handle >= FS_SUPERVISOR_MAX_NUM_TASKS)
+  {
+    handle = -1;
+  }
+
+  else
+  {
+    task = &tasks[handle];
+    task->name = name;
+    task->deadlineMicroseconds = deadlineMicroseconds;
+    atomic_store(&task->lastKickMicroseconds, now());
+    atomic_store(&task->state, TASK_STATE_OK);
+
+    // Publish only once the entry is complete, so tick() never sees half of it.
+    atomic_store(&numTasks, handle + 1);
+  }
+
+  xSemaphoreGive(registryMutex);
+
+  return handle;
+}
+
+static void kick(int16_t handle)
+{
+  SupervisedTask_t * task;
+  uint32_t timestamp, interval;
+  unsigned int state;
+
+  if( ( handle < 0 ) || ( handle >= atomic_load(&numTasks) ) )
+  {
+    return;
+  }
+
+  task = &tasks[handle];
+  timestamp = now();
+  interval = timestamp - atomic_load_explicit(&task->lastKickMicroseconds, memory_order_relaxed);
+
+  atomic_fetch_add_explicit( &task->histogram[histogramBucket(interval)], 1,
+                             memory_order_relaxed );
+
+  if( interval > atomic_load_explicit(&task->worstIntervalMicroseconds, memory_order_relaxed) )
+  {
+    atomic_store_explicit(&task->worstIntervalMicroseconds, interval, memory_order_relaxed);
+  }
+
+  atomic_store(&task->lastKickMicroseconds, timestamp);
+
+  /*
+  A fatal stall stays latched; anything less is cleared by making progress.
+  Compare and swap, so that a stall flagged by tick() in the meantime is kept.
+  */
+  state = atomic_load(&task->state);
+
+  while( ( TASK_STATE_OK != state ) && ( state < TASK_STATE_FATAL_PENDING ) &&
+         !atomic_compare_exchange_weak(&task->state, &state, TASK_STATE_OK) );
+}
+
+static void tick(void)
+{
+  int16_t i, count;
+  uint32_t timestamp, overdue;
+  unsigned int expected;
+  SupervisedTask_t * task;
+  BaseType_t higherPriorityTaskWoken;
+  _Bool wakeSupervisor;
+
+  timestamp = now();
+  count = atomic_load(&numTasks);
+  wakeSupervisor = false;
+
+  // One subtraction and compare per task in the common, healthy case.
+  for(i = 0; i < count; i++)
+  {
+    task = &tasks[i];
+    overdue = timestamp - atomic_load(&task->lastKickMicroseconds);
+
+    if(overdue <= task->deadlineMicroseconds)
+    {
+      continue;
+    }
+
+    if( overdue / FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER > task->deadlineMicroseconds )
+    {
+      expected = atomic_load(&task->state);
+
+      while( ( expected < TASK_STATE_FATAL_PENDING ) &&
+             !atomic_compare_exchange_weak(&task->state, &expected, TASK_STATE_FATAL_PENDING) );
+
+      if(expected < TASK_STATE_FATAL_PENDING)
+      {
+        lastFatalStall.name = task->name;
+        lastFatalStall.deadlineMicroseconds = task->deadlineMicroseconds;
+        lastFatalStall.overdueMicroseconds = overdue;
+        atomic_store(&fatalStallRecorded, true);
+        wakeSupervisor = true;
+      }
+    }
+
+    else
+    {
+      expected = TASK_STATE_OK;
+
+      if( atomic_compare_exchange_strong(&task->state, &expected, TASK_STATE_WARNING_PENDING) )
+      {
+        wakeSupervisor = true;
+      }
+    }
+  }
+
+  if(wakeSupervisor && supervisorTask)
+  {
+    higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(supervisorTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+  }
+}
+
+static void mainLoop(void * params)
+{
+  int16_t i, count;
+  unsigned int expected;
+  SupervisedTask_t * task;
+
+  supervisorTask = xTaskGetCurrentTaskHandle();
+
+  while(true)
+  {
+    // Woken by tick() when a task becomes overdue or stalls.
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    count = atomic_load(&numTasks);
+
+    for(i = 0; i < count; i++)
+    {
+      task = &tasks[i];
+      expected = TASK_STATE_WARNING_PENDING;
+
+      if( atomic_compare_exchange_strong(&task->state, &expected, TASK_STATE_WARNED) && exc )
+      {
+        exc->raiseWarning( excModuleLabel,
+                           "Task '%s' missed its %lu us heartbeat deadline",
+                           task->name,
+                           (unsigned long)task->deadlineMicroseconds );
+      }
+
+      expected = TASK_STATE_FATAL_PENDING;
+
+      if( atomic_compare_exchange_strong(&task->state, &expected, TASK_STATE_FATAL) && exc )
+      {
+        exc->raiseFatal( excModuleLabel,
+                         "Task '%s' stalled: no heartbeat for %lu us (deadline %lu us)",
+                         task->name,
+                         (unsigned long)( now() - atomic_load(&task->lastKickMicroseconds) ),
+                         (unsigned long)task->deadlineMicroseconds );
+      }
+    }
+  }
+}
+
+static uint32_t now(void)
+{
+  // Only the low word is used, so a torn read of the high word is harmless.
+  return (uint32_t)( *timeMicroseconds );
+}
+
+static uint8_t histogramBucket(uint32_t intervalMicroseconds)
+{
+  uint8_t bucket;
+
+  bucket = 0;
+
+  while(intervalMicroseconds >>= 1)
+  {
+    bucket++;
+  }
+
+  return bucket;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -3,6 +3,10 @@
 
 // System components.
 #include "FS_Console.h"
+#include "FS_Logging.h"
+#include "FS_LogStore.h"
+#include "FS_Supervisor.h"
+#include "FS_Metrics.h"
 
 // C standard library includes.
 #include <stdbool.h>
@@ -14,6 +18,39 @@
 // Project must provide this file for all system subcomponent task priority defines.
 #include "FS_TaskPriorities_Conf.h"
 
+#ifndef FS_CONSOLE_DRAIN_STACK_DEPTH
+#define FS_CONSOLE_DRAIN_STACK_DEPTH FS_CONSOLE_STACK_DEPTH
+#endif
+
+#ifndef FS_CONSOLE_DRAIN_TASK_PRIORITY
+#define FS_CONSOLE_DRAIN_TASK_PRIORITY FS_CONSOLE_TASK_PRIORITY
+#endif
+
+#ifndef FS_SUPERVISOR_STACK_DEPTH
+#define FS_SUPERVISOR_STACK_DEPTH FS_CONSOLE_STACK_DEPTH
+#endif
+
+#ifndef FS_LOGGING_STACK_DEPTH
+#define FS_LOGGING_STACK_DEPTH FS_CONSOLE_STACK_DEPTH
+#endif
+
+#ifndef FS_LOGGING_TASK_PRIORITY
+#define FS_LOGGING_TASK_PRIORITY FS_CONSOLE_TASK_PRIORITY
+#endif
+
+#ifndef FS_METRICS_STACK_DEPTH
+#define FS_METRICS_STACK_DEPTH FS_CONSOLE_STACK_DEPTH
+#endif
+
+#ifndef FS_METRICS_TASK_PRIORITY
+#define FS_METRICS_TASK_PRIORITY FS_CONSOLE_TASK_PRIORITY
+#endif
+
+// High, so that warnings still get out while lower priority tasks are starved.
+#ifndef FS_SUPERVISOR_TASK_PRIORITY
+#define FS_SUPERVISOR_TASK_PRIORITY ( configMAX_PRIORITIES - 1 )
+#endif
+
 /*
 {
   FS_SystemTime_t * time;
@@ -25,9 +62,86 @@
 }FS_GenericModuleSystemBinding_t;
 */
 
-static void initConsole(FS_Console_InitReturnsStruct_t * returns, FS_DT_IOStream_t * debugUART);
+/*
+Subsystem init graph. Each step names the steps it depends on and is only run
+once all of them have succeeded; if any dependency fails the step is skipped
+rather than run against a half initialised system. To add a subsystem, add an
+ID here and an entry to initSteps[].
+*/
+typedef enum
+{
+  INIT_STEP_SUPERVISOR,
+  INIT_STEP_SUPERVISOR_TASK,
+  INIT_STEP_CONSOLE,
+  INIT_STEP_CONSOLE_TASKS,
+  INIT_STEP_SYSTEM_COMMANDS,
+  INIT_STEP_LOG_STORE,
+  INIT_STEP_LOGGING,
+  INIT_STEP_LOGGING_TASK,
+  INIT_STEP_METRICS,
+  INIT_STEP_METRICS_TASK,
+  NUM_INIT_STEPS
+
+}InitStepID_t;
+
+#define INIT_DEPENDS_ON(step) ( 1UL << (step) )
+
+typedef struct
+{
+  const char * name;
+  _Bool(*init)(void);
+  uint32_t dependencies;
+
+}InitStep_t;
+
+_Static_assert(NUM_INIT_STEPS <= 32, "FS_System: dependency masks are 32 bits wide");
+
+static _Bool initSupervisor(void);
+static _Bool startSupervisorTask(void);
+static _Bool initConsole(void);
+static _Bool startConsoleTasks(void);
+static _Bool registerSystemCommands(void);
+static _Bool initLogStore(void);
+static _Bool initLogging(void);
+static _Bool startLoggingTask(void);
+static _Bool initMetrics(void);
+static _Bool startMetricsTask(void);
+static _Bool runInitGraph(void);
+static uint64_t getTimeMicroseconds(void);
+static void bootCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console);
+static void healthCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console);
+
+static const InitStep_t initSteps[NUM_INIT_STEPS] =
+{
+  [INIT_STEP_SUPERVISOR]      = { "supervisor",     initSupervisor,         0 },
+  [INIT_STEP_SUPERVISOR_TASK] = { "supervisorTask", startSupervisorTask,    INIT_DEPENDS_ON(INIT_STEP_SUPERVISOR) },
+  [INIT_STEP_CONSOLE]         = { "console",        initConsole,            INIT_DEPENDS_ON(INIT_STEP_SUPERVISOR) },
+  [INIT_STEP_CONSOLE_TASKS]   = { "consoleTasks",   startConsoleTasks,      INIT_DEPENDS_ON(INIT_STEP_CONSOLE) },
+  [INIT_STEP_SYSTEM_COMMANDS] = { "systemCommands", registerSystemCommands, INIT_DEPENDS_ON(INIT_STEP_CONSOLE) },
+  [INIT_STEP_LOG_STORE]       = { "logStore",       initLogStore,           0 },
+  [INIT_STEP_LOGGING]         = { "logging",        initLogging,            INIT_DEPENDS_ON(INIT_STEP_CONSOLE) |
+                                                                            INIT_DEPENDS_ON(INIT_STEP_LOG_STORE) },
+  [INIT_STEP_LOGGING_TASK]    = { "loggingTask",    startLoggingTask,       INIT_DEPENDS_ON(INIT_STEP_LOGGING) },
+  [INIT_STEP_METRICS]         = { "metrics",        initMetrics,            0 },
+  [INIT_STEP_METRICS_TASK]    = { "metricsTask",    startMetricsTask,       INIT_DEPENDS_ON(INIT_STEP_METRICS) },
+
+  // initException();
+  // initFilesystem();
+};
 
 static FS_GenericModuleSystemBinding_t * sysInstance;
+static FS_System_InitStruct_t * config;
+static FS_Console_t console;
+static FS_Console_InitReturnsStruct_t consoleReturns;
+static FS_Logging_t logging;
+static FS_Logging_InitReturnsStruct_t loggingReturns;
+static FS_Supervisor_t supervisor;
+static FS_Supervisor_InitReturnsStruct_t supervisorReturns;
+static FS_Metrics_t metrics;
+static FS_Metrics_InitReturnsStruct_t metricsReturns;
+static FS_System_InitStepRecord_t bootTimeline[NUM_INIT_STEPS];
+static uint8_t numBootTimelineRecords;
+static uint64_t bootStartMicroseconds;
 
 static uint16_t timerIntervalMicroseconds;
 static _Bool moduleInitialised = false;
@@ -37,66 +151,436 @@ void FS_System_InitStructInit(FS_System_InitStruct_t * initStruct)
   initStruct->timerIntervalMicroseconds = 0xFFFF;
   initStruct->sysInstance = NULL;
   initStruct->usart = NULL;
+  initStruct->getTimeMicroseconds = NULL;
+  initStruct->logStorePath = NULL;
+  initStruct->logStoreSizeBytes = 0;
+  initStruct->logStoreSectorSizeBytes = 4096;
+  initStruct->metricsIO = NULL;
+  initStruct->metricsPath = NULL;
+  initStruct->metricsFileSizeBytes = 0;
+  initStruct->metricsSamplePeriodTicks = 0;
 }
 
 _Bool FS_System_Init(FS_System_InitStruct_t * initStruct)
 {
-  FS_Console_InitReturnsStruct_t consoleReturns;
-  TaskHandle_t taskHandle;
+  _Bool success;
 
   // Get a reference to the instance of the binding struct.
   sysInstance = initStruct->sysInstance;
+  config = initStruct;
 
   // Init the global timer.
   sysInstance->timeMicroseconds = 0;
 
-
   timerIntervalMicroseconds = initStruct->timerIntervalMicroseconds;
-  // initException()();
-  // initFilesystem();
-  // initConsole();
-  // initLogging();
 
   moduleInitialised = true;
 
-  // Init the debug console module.
-  initConsole(&consoleReturns, initStruct->usart);
+  success = runInitGraph();
 
-  // Start the debug console task.
-  if(consoleReturns.success)
+  sysInstance->isInitialised = success;
+
+  return success;
+}
+
+void FS_System_TimerTick(void)
+{
+  if(!moduleInitialised)
+  {
+    return;
+  }
+
+  sysInstance->timeMicroseconds += timerIntervalMicroseconds;
+
+  if(supervisorReturns.tick)
+  {
+    supervisorReturns.tick();
+  }
+
+  if(metricsReturns.tick)
+  {
+    metricsReturns.tick();
+  }
+}
+
+uint8_t FS_System_GetBootTimeline(const FS_System_InitStepRecord_t ** records)
+{
+  *records = bootTimeline;
+  return numBootTimelineRecords;
+}
+
+void FS_System_PrintBootTimeline(int(*printfFn)(const char * fmt, ...))
+{
+  uint8_t i;
+  uint64_t totalMicroseconds;
+  static const char * statusStrings[] = { "not run", "ok", "FAILED", "skipped" };
+
+  printfFn("\r\n  start(us)  duration(us)  status   step\r\n");
+
+  totalMicroseconds = 0;
+
+  for(i = 0; i < numBootTimelineRecords; i++)
+  {
+    printfFn( "%11lu  %12lu  %-7s  %s\r\n",
+              (unsigned long)( bootTimeline[i].startMicroseconds - bootStartMicroseconds ),
+              (unsigned long)bootTimeline[i].durationMicroseconds,
+              statusStrings[bootTimeline[i].status],
+              bootTimeline[i].name );
+
+    totalMicroseconds = bootTimeline[i].startMicroseconds
+                        + bootTimeline[i].durationMicroseconds
+                        - bootStartMicroseconds;
+  }
+
+  printfFn("Boot to ready: %lu us\r\n\n", (unsigned long)totalMicroseconds);
+}
+
+/*
+Runs initSteps[] in dependency order and records a timeline entry for every
+step. Steps are run in waves: every step whose dependencies have all completed
+joins the current wave, so the steps of one wave are independent of each
+other. They are run in turn on the calling context, as FS_System_Init() is
+normally called before the scheduler is started and there is nothing to run
+them on in parallel. A failure only skips the failed step's dependents; the
+rest of the graph still comes up. Returns true only if every step succeeded.
+*/
+static _Bool runInitGraph(void)
+{
+  uint32_t completed, failed, pending, wave, allSteps;
+  uint8_t i;
+  uint64_t start;
+  FS_System_InitStepRecord_t * record;
+
+  allSteps = ( NUM_INIT_STEPS < 32 ) ? ( ( 1UL << NUM_INIT_STEPS ) - 1 ) : 0xFFFFFFFFUL;
+  completed = 0;
+  failed = 0;
+  pending = allSteps;
+  numBootTimelineRecords = 0;
+  bootStartMicroseconds = getTimeMicroseconds();
+
+  while(pending)
   {
-    xTaskCreate( consoleReturns.mainLoop,
-                 "FS_Console",
-                 FS_CONSOLE_STACK_DEPTH,
-                 NULL,
-                 FS_CONSOLE_TASK_PRIORITY,
-                 &taskHandle );
+    wave = 0;
+
+    for(i = 0; i < NUM_INIT_STEPS; i++)
+    {
+      if( !( pending & INIT_DEPENDS_ON(i) ) )
+      {
+        continue;
+      }
+
+      // A dependency failed or was itself skipped - skip this step too.
+      if(initSteps[i].dependencies & failed)
+      {
+        record = &bootTimeline[numBootTimelineRecords++];
+        record->name = initSteps[i].name;
+        record->status = FS_System_InitStepSkipped;
+        record->startMicroseconds = getTimeMicroseconds();
+        record->durationMicroseconds = 0;
+
+        failed |= INIT_DEPENDS_ON(i);
+        pending &= ~INIT_DEPENDS_ON(i);
+      }
+
+      else if( ( initSteps[i].dependencies & completed ) == initSteps[i].dependencies )
+      {
+        wave |= INIT_DEPENDS_ON(i);
+      }
+    }
+
+    // Nothing runnable but steps outstanding - a dependency cycle. Skip them.
+    if(!wave)
+    {
+      for(i = 0; i < NUM_INIT_STEPS; i++)
+      {
+        if( pending & INIT_DEPENDS_ON(i) )
+        {
+          record = &bootTimeline[numBootTimelineRecords++];
+          record->name = initSteps[i].name;
+          record->status = FS_System_InitStepSkipped;
+          record->startMicroseconds = getTimeMicroseconds();
+          record->durationMicroseconds = 0;
+
+          failed |= INIT_DEPENDS_ON(i);
+        }
+      }
+
+      break;
+    }
+
+    for(i = 0; i < NUM_INIT_STEPS; i++)
+    {
+      if( !( wave & INIT_DEPENDS_ON(i) ) )
+      {
+        continue;
+      }
+
+      record = &bootTimeline[numBootTimelineRecords++];
+      record->name = initSteps[i].name;
+
+      start = getTimeMicroseconds();
+
+      if( initSteps[i].init() )
+      {
+        record->status = FS_System_InitStepOk;
+        completed |= INIT_DEPENDS_ON(i);
+      }
+
+      else
+      {
+        record->status = FS_System_InitStepFailed;
+        failed |= INIT_DEPENDS_ON(i);
+      }
+
+      record->startMicroseconds = start;
+      record->durationMicroseconds = (uint32_t)( getTimeMicroseconds() - start );
+    }
+
+    pending &= ~wave;
+  }
+
+  return ( completed == allSteps );
+}
+
+static uint64_t getTimeMicroseconds(void)
+{
+  // Prefer the application's fine grained clock; fall back to the tick count.
+  if(config->getTimeMicroseconds)
+  {
+    return config->getTimeMicroseconds();
+  }
+
+  return sysInstance->timeMicroseconds;
+}
+
+static _Bool initSupervisor(void)
+{
+  FS_Supervisor_InitStruct_t initStruct;
+
+  FS_Supervisor_InitStructInit(&initStruct);
+  FS_Supervisor_InitReturnsStructInit(&supervisorReturns);
 
-    configASSERT(taskHandle);
+  initStruct.instance = &supervisor;
+  initStruct.exc = sysInstance->exc;
+  initStruct.timeMicroseconds = &sysInstance->timeMicroseconds;
+
+  FS_Supervisor_Init(&initStruct, &supervisorReturns);
+
+  if(supervisorReturns.success)
+  {
+    sysInstance->supervisor = &supervisor;
   }
+
+  return supervisorReturns.success;
 }
 
-static void initConsole(FS_Console_InitReturnsStruct_t * returns, FS_DT_IOStream_t * debugUART)
+static _Bool startSupervisorTask(void)
+{
+  TaskHandle_t taskHandle;
+
+  return ( pdPASS == xTaskCreate( supervisorReturns.mainLoop,
+                                  "FS_Supervisor",
+                                  FS_SUPERVISOR_STACK_DEPTH,
+                                  NULL,
+                                  FS_SUPERVISOR_TASK_PRIORITY,
+                                  &taskHandle ) );
+}
+
+static _Bool initConsole(void)
 {
   FS_Console_InitStruct_t initStruct;
 
+  if(!config->usart)
+  {
+    return false;
+  }
 
   // Initialise the data structures.
   FS_Console_InitStructInit(&initStruct);
-  FS_Console_InitReturnsStructInit(returns);
+  FS_Console_InitReturnsStructInit(&consoleReturns);
 
   initStruct.echo = true;
   initStruct.echoToAllOutputStreams = true;
-  initStruct.instance = &(sysInstance->console);
-  initStruct.io = debugUART;
+  initStruct.instance = &console;
+  initStruct.io = config->usart;
+  initStruct.supervisor = &supervisor;
+
+  FS_Console_Init(&initStruct, &consoleReturns);
+
+  if(consoleReturns.success)
+  {
+    sysInstance->console = &console;
+  }
+
+  return consoleReturns.success;
+}
+
+static _Bool startConsoleTasks(void)
+{
+  TaskHandle_t taskHandle;
+
+  // Start the debug console task.
+  if( pdPASS != xTaskCreate( consoleReturns.mainLoop,
+                             "FS_Console",
+                             FS_CONSOLE_STACK_DEPTH,
+                             NULL,
+                             FS_CONSOLE_TASK_PRIORITY,
+                             &taskHandle ) )
+  {
+    return false;
+  }
+
+  // Start the task which merges the per-core console output.
+  if( pdPASS != xTaskCreate( consoleReturns.drainLoop,
+                             "FS_ConsoleDrain",
+                             FS_CONSOLE_DRAIN_STACK_DEPTH,
+                             NULL,
+                             FS_CONSOLE_DRAIN_TASK_PRIORITY,
+                             &taskHandle ) )
+  {
+    return false;
+  }
+
+  return true;
+}
+
+static _Bool registerSystemCommands(void)
+{
+  return sysInstance->console->registerCommand( "boot",
+                                                bootCommand,
+                                                "Shows the time taken by each FS_System init step." )
+         && sysInstance->console->registerCommand( "health",
+                                                   healthCommand,
+                                                   "Shows task heartbeats and histograms of the intervals between their kicks." );
+}
+
+static void bootCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  FS_System_PrintBootTimeline(sysInstance->console->printf);
+}
+
+static _Bool initLogStore(void)
+{
+  FS_LogStore_InitStruct_t initStruct;
+
+  // The persistent store is optional; without it logging goes to the console only.
+  if(!config->logStorePath)
+  {
+    return true;
+  }
+
+  FS_LogStore_InitStructInit(&initStruct);
+
+  initStruct.fs = sysInstance->fs;
+  initStruct.path = config->logStorePath;
+  initStruct.sizeBytes = config->logStoreSizeBytes;
+  initStruct.sectorSizeBytes = config->logStoreSectorSizeBytes;
 
-  FS_Console_Init(&initStruct, returns);
+  return FS_LogStore_Init(&initStruct);
 }
 
-static void mainLoop(void * params)
+static _Bool initLogging(void)
 {
-  while(true)
+  FS_Logging_InitStruct_t initStruct;
+
+  FS_Logging_InitStructInit(&initStruct);
+  FS_Logging_InitReturnsStructInit(&loggingReturns);
+
+  initStruct.instance = &logging;
+  initStruct.console = sysInstance->console;
+  initStruct.timeMicroseconds = &sysInstance->timeMicroseconds;
+
+  FS_Logging_Init(&initStruct, &loggingReturns);
+
+  if(loggingReturns.success)
   {
+    sysInstance->log = &logging;
+  }
 
+  return loggingReturns.success;
+}
+
+static _Bool startLoggingTask(void)
+{
+  TaskHandle_t taskHandle;
+
+  // No log store - lines only go to the console, so there is nothing to write.
+  if(!loggingReturns.writerLoop)
+  {
+    return true;
   }
+
+  return ( pdPASS == xTaskCreate( loggingReturns.writerLoop,
+                                  "FS_LogWriter",
+                                  FS_LOGGING_STACK_DEPTH,
+                                  NULL,
+                                  FS_LOGGING_TASK_PRIORITY,
+                                  &taskHandle ) );
+}
+
+static void healthCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  FS_Supervisor_PrintReport(sysInstance->console->printf);
+}
+
+static _Bool initMetrics(void)
+{
+  FS_Metrics_InitStruct_t initStruct;
+  uint32_t periodTicks;
+
+  FS_Metrics_InitStructInit(&initStruct);
+  FS_Metrics_InitReturnsStructInit(&metricsReturns);
+
+  initStruct.instance = &metrics;
+  initStruct.timeMicroseconds = &sysInstance->timeMicroseconds;
+  initStruct.getTimeMicroseconds = config->getTimeMicroseconds;
+  initStruct.io = config->metricsIO;
+  initStruct.fs = sysInstance->fs;
+  initStruct.path = config->metricsPath;
+
+  if(config->metricsFileSizeBytes)
+  {
+    initStruct.fileSizeBytes = config->metricsFileSizeBytes;
+  }
+
+  // Default to sampling once a second.
+  if(config->metricsSamplePeriodTicks)
+  {
+    initStruct.samplePeriodTicks = config->metricsSamplePeriodTicks;
+  }
+
+  else if(timerIntervalMicroseconds)
+  {
+    periodTicks = ( 1000000UL + timerIntervalMicroseconds - 1 ) / timerIntervalMicroseconds;
+
+    // Ticks shorter than 16us would overflow the counter; sample as slowly as it allows.
+    initStruct.samplePeriodTicks = ( periodTicks > UINT16_MAX ) ? UINT16_MAX : (uint16_t)periodTicks;
+  }
+
+  FS_Metrics_Init(&initStruct, &metricsReturns);
+
+  if(metricsReturns.success)
+  {
+    sysInstance->metrics = &metrics;
+  }
+
+  return metricsReturns.success;
+}
+
+static _Bool startMetricsTask(void)
+{
+  TaskHandle_t taskHandle;
+
+  // No sink configured - the registry still works, there is just nothing to stream.
+  if(!metricsReturns.samplerLoop)
+  {
+    return true;
+  }
+
+  return ( pdPASS == xTaskCreate( metricsReturns.samplerLoop,
+                                  "FS_Metrics",
+                                  FS_METRICS_STACK_DEPTH,
+                                  NULL,
+                                  FS_METRICS_TASK_PRIORITY,
+                                  &taskHandle ) );
 }
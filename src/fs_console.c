@@ -28,28 +28,137 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 
 // FreeRTOS includes.
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
 
 /*------------------------------------------------------------------------------
 ------------------------------- END INCLUDES -----------------------------------
 ------------------------------------------------------------------------------*/
 
 
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINES ---------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+consolePrintf() may be called from any task on any core. Each core formats in
+to its own output ring so that producers on different cores never contend; a
+single drain task merges the rings on to the IO streams.
+*/
+#ifndef FS_CONSOLE_NUM_CORES
+  #ifdef configNUMBER_OF_CORES
+    #define FS_CONSOLE_NUM_CORES configNUMBER_OF_CORES
+  #else
+    #define FS_CONSOLE_NUM_CORES 1
+  #endif
+#endif
+
+#if FS_CONSOLE_NUM_CORES > 1
+  #define FS_CONSOLE_GET_CORE_ID() portGET_CORE_ID()
+#else
+  #define FS_CONSOLE_GET_CORE_ID() 0
+#endif
+
+// Size of each per-core output ring. Must hold at least one formatted message.
+#ifndef FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES
+  #define FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES ( 4 * FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES )
+#endif
+
+// Ticks the console task sleeps for when no input is waiting.
+#ifndef FS_CONSOLE_POLL_PERIOD_TICKS
+  #define FS_CONSOLE_POLL_PERIOD_TICKS 1
+#endif
+
+/*
+Longest the console task may go without a heartbeat. Waiting for input and
+writing output count as progress; a command callback which does neither, nor
+calls heartbeat(), within this time is reported as overdue.
+*/
+#ifndef FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS
+  #define FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS 1000000UL
+#endif
+
+// Ticks the drain task sleeps for when all rings are empty.
+#ifndef FS_CONSOLE_DRAIN_PERIOD_TICKS
+  #define FS_CONSOLE_DRAIN_PERIOD_TICKS 1
+#endif
+
+#if FS_CONSOLE_NUM_CORES < 1
+#error "FS_Console: FS_CONSOLE_NUM_CORES must be at least 1"
+#endif
+
+// One slot is always left empty to tell a full ring from an empty one.
+#if FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES < ( FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES + 1 )
+#error "FS_Console: FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES must exceed FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES"
+#endif
+
+#if FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES <= UINT8_MAX
+typedef uint8_t RingIndex_t;
+#elif FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES <= UINT16_MAX
+typedef uint16_t RingIndex_t;
+#else
+typedef uint32_t RingIndex_t;
+#endif
+
+// The drain task hands ring contents to output() in pieces of at most this many bytes.
+#define OUTPUT_LENGTH_MAX ( (FS_Console_OutputLength_t)-1 )
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINES ----------------------------------
+------------------------------------------------------------------------------*/
+
+
 /*------------------------------------------------------------------------------
 --------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
 ------------------------------------------------------------------------------*/
 
+/*
+An immutable view of the IO stream list. Once published a snapshot is never
+modified; writers fill in the spare snapshot and swap the published pointer.
+*/
 typedef struct
 {
   FS_DT_IOStream_t * interfaces[FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS];
-  uint8_t defaultInterfaceIndex;
+  FS_Console_StreamIndex_t defaultInterfaceIndex;
+
+}IOStreamSnapshot_t;
+
+/*
+The IO stream list is published RCU style. Readers (every received byte and
+every output() call) never block: they count themselves in to the current
+reader phase, load the published snapshot and count themselves out again.
+Writers are serialised by the mutex, publish a new snapshot and then wait for
+a grace period - both reader phases draining to zero - before the old
+snapshot may be reused.
+*/
+typedef struct
+{
+  IOStreamSnapshot_t snapshots[2];
+  IOStreamSnapshot_t * _Atomic current;
+  atomic_uint readers[2];
+  atomic_uint phase;
   SemaphoreHandle_t mutex;
 
 }IOStreams_t;
 
+/*
+Single producer (whichever task is running on the owning core, with that
+core's interrupts masked) / single consumer (the drain task) byte ring. Only
+complete messages are published, so the drain task never splits one.
+*/
+typedef struct
+{
+  char buffer[FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES];
+  _Atomic RingIndex_t head; // Written by the producer only.
+  _Atomic RingIndex_t tail; // Written by the drain task only.
+  atomic_uint droppedBytes;
+
+}CoreOutputRing_t;
+
 typedef struct
 {
   const char * cmd;
@@ -71,17 +180,27 @@ typedef struct
 
 static _Bool registerCommand( const char * cmd,
                               void(*callback)( const char * argv,
-                                               FS_DT_IOStream_t * io ),
+                                               FS_Console_CommandCallbackInterface_t * console ),
                               const char * helpString );
 static int consolePrintf(const char * fmt, ...);
 static void mainLoop(void * params);
+static void drainLoop(void * params);
+static void coreOutputRingWrite(const char * buf, FS_Console_OutputLength_t numBytes);
+static _Bool coreOutputRingDrain(CoreOutputRing_t * ring);
+static void outputRingSpan(const char * buf, RingIndex_t numBytes);
 static _Bool inputLineAvailable(void);
-static void output(const char * buf, uint16_t numBytes);
+static void waitForInputLine(void);
+static void heartbeat(void);
+static void output(const char * buf, FS_Console_OutputLength_t numBytes);
 static void executeCommand(void);
 static void doBufferOverwhelmedActions(void);
 static void doBadCommandActions(void);
 static void addIOStreamCallback(FS_DT_IOStream_t * newIO);
 static void removeIOStreamCallback(FS_DT_IOStream_t * oldIO);
+static const IOStreamSnapshot_t * ioReadLock(unsigned int * phase);
+static void ioReadUnlock(unsigned int phase);
+static IOStreamSnapshot_t * ioWriteBegin(void);
+static void ioWriteCommit(IOStreamSnapshot_t * next);
 static void help(const char * argv, FS_Console_CommandCallbackInterface_t * console);
 
 /*------------------------------------------------------------------------------
@@ -94,11 +213,16 @@ static void help(const char * argv, FS_Console_CommandCallbackInterface_t * cons
 
 static FS_Console_t * instance;
 static IOStreams_t io;
+static CoreOutputRing_t coreOutputRings[FS_CONSOLE_NUM_CORES];
 static Command_t commandTable[FS_CONSOLE_MAX_NUM_COMMANDS];
-static uint16_t numRegisteredCommands;
+static FS_Console_CommandIndex_t numRegisteredCommands;
 static FS_Console_Input_t input;
 static _Bool echo;
 static _Bool echoToAllOutputStreams;
+static FS_Supervisor_t * supervisor;
+static int16_t heartbeatHandle = -1;
+static _Bool inputIdle; // Set when the last poll found no input waiting.
+static TaskHandle_t consoleTask; // Set once mainLoop() is running.
 
 /*------------------------------------------------------------------------------
 ---------------------- END PRIVATE GLOBAL VARIABLES ----------------------------
@@ -115,6 +239,7 @@ void FS_Console_InitStructInit(FS_Console_InitStruct_t * initStruct)
   initStruct->echoToAllOutputStreams = false;
   initStruct->instance = NULL;
   initStruct->io = NULL;
+  initStruct->supervisor = NULL;
 }
 
 void FS_Console_InitReturnsStructInit(FS_Console_InitReturnsStruct_t * returnsStruct)
@@ -122,23 +247,33 @@ void FS_Console_InitReturnsStructInit(FS_Console_InitReturnsStruct_t * returnsSt
   returnsStruct->addIOStreamCallback = NULL;
   returnsStruct->removeIOStreamCallback = NULL;
   returnsStruct->mainLoop = NULL;
+  returnsStruct->drainLoop = NULL;
+  returnsStruct->success = false;
 }
 
 
 void FS_Console_Init( FS_Console_InitStruct_t * initStruct,
                       FS_Console_InitReturnsStruct_t * returns )
 {
-  // Create a mutex to protect the list of IO streams.
+  // Create a mutex to serialise writers of the list of IO streams.
   io.mutex = xSemaphoreCreateMutex();
 
   // Transfer the pertinent fields from the init struct.
   echo = initStruct->echo;
   echoToAllOutputStreams = initStruct->echoToAllOutputStreams;
   instance = initStruct->instance;
+  supervisor = initStruct->supervisor;
 
-  // Copy in the default IO stream interface.
-  io.interfaces[0] = initStruct->io;
-  io.defaultInterfaceIndex = 0;
+  /*
+  Copy in the default IO stream interface and publish the first snapshot. No
+  readers can exist yet so there is no need for a grace period.
+  */
+  io.snapshots[0].interfaces[0] = initStruct->io;
+  io.snapshots[0].defaultInterfaceIndex = 0;
+  atomic_init(&io.readers[0], 0);
+  atomic_init(&io.readers[1], 0);
+  atomic_init(&io.phase, 0);
+  atomic_init(&io.current, &io.snapshots[0]);
 
   // Bind the instance to the implementation.
   instance->printf = consolePrintf;
@@ -148,6 +283,7 @@ void FS_Console_Init( FS_Console_InitStruct_t * initStruct,
   returns->addIOStreamCallback = addIOStreamCallback;
   returns->removeIOStreamCallback = removeIOStreamCallback;
   returns->mainLoop = mainLoop;
+  returns->drainLoop = drainLoop;
   returns->success = true;
 
   // Add the built-in commands to the command table.
@@ -165,7 +301,7 @@ void FS_Console_Init( FS_Console_InitStruct_t * initStruct,
 
 static _Bool registerCommand( const char * cmd,
                               void(*callback)( const char * argv,
-                                               FS_DT_IOStream_t * io ),
+                                               FS_Console_CommandCallbackInterface_t * console ),
                               const char * helpString )
 {
   if(numRegisteredCommands < FS_CONSOLE_MAX_NUM_COMMANDS)
@@ -188,7 +324,7 @@ static int consolePrintf(const char * fmt, ...)
   va_list arg;
   int bytes;
   char outputBuffer[FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES];
-  uint16_t length;
+  FS_Console_OutputLength_t length;
 
   va_start(arg, fmt);
   bytes = vsnprintf(outputBuffer, FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES, fmt, arg);
@@ -196,14 +332,156 @@ static int consolePrintf(const char * fmt, ...)
 
   length = strlen(outputBuffer);
 
-  output(outputBuffer, length);
+  /*
+  Command callbacks run on the console task and their output must appear
+  before the prompt that follows, and a long report must not be limited to
+  what one ring can hold, so write it straight out. Every other task hands the
+  message to this core's ring and the drain task writes it out.
+  */
+  if( consoleTask && ( xTaskGetCurrentTaskHandle() == consoleTask ) )
+  {
+    output(outputBuffer, length);
+  }
+
+  else
+  {
+    coreOutputRingWrite(outputBuffer, length);
+  }
 
   return bytes;
 }
 
+static void coreOutputRingWrite(const char * buf, FS_Console_OutputLength_t numBytes)
+{
+  UBaseType_t savedInterruptMask;
+  CoreOutputRing_t * ring;
+  RingIndex_t head, tail, space, firstChunk;
+
+  /*
+  Masking interrupts on this core only stops the task being preempted or
+  migrated between reading the core ID and publishing the new head. Unlike
+  taskENTER_CRITICAL() on an SMP kernel, this takes no cross-core lock.
+  */
+  savedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+  ring = &coreOutputRings[FS_CONSOLE_GET_CORE_ID()];
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  if(head >= tail)
+  {
+    space = FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES - ( head - tail ) - 1;
+  }
+
+  else
+  {
+    space = tail - head - 1;
+  }
+
+  // Drop whole messages rather than interleave fragments.
+  if(numBytes > space)
+  {
+    atomic_fetch_add_explicit(&ring->droppedBytes, numBytes, memory_order_relaxed);
+  }
+
+  else
+  {
+    firstChunk = FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES - head;
+
+    if(numBytes < firstChunk)
+    {
+      firstChunk = numBytes;
+    }
+
+    memcpy(&ring->buffer[head], buf, firstChunk);
+    memcpy(&ring->buffer[0], &buf[firstChunk], numBytes - firstChunk);
+
+    head = ( head + numBytes ) % FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+  }
+
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(savedInterruptMask);
+}
+
+// Returns true if anything was written out.
+static _Bool coreOutputRingDrain(CoreOutputRing_t * ring)
+{
+  RingIndex_t head, tail;
+  unsigned int dropped;
+  char droppedMsg[48];
+
+  head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  dropped = atomic_exchange_explicit(&ring->droppedBytes, 0, memory_order_relaxed);
+
+  if(head == tail && !dropped)
+  {
+    return false;
+  }
+
+  // Wrapped - write out up to the end of the buffer first.
+  if(head < tail)
+  {
+    outputRingSpan(&ring->buffer[tail], FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES - tail);
+    tail = 0;
+  }
+
+  if(head > tail)
+  {
+    outputRingSpan(&ring->buffer[tail], head - tail);
+  }
+
+  atomic_store_explicit(&ring->tail, head, memory_order_release);
+
+  if(dropped)
+  {
+    output( droppedMsg,
+            snprintf(droppedMsg, sizeof(droppedMsg), "\r\n[console: %u bytes dropped]\r\n", dropped) );
+  }
+
+  return true;
+}
+
+// A ring may be longer than output() takes in one call.
+static void outputRingSpan(const char * buf, RingIndex_t numBytes)
+{
+  FS_Console_OutputLength_t chunk;
+
+  while(numBytes)
+  {
+    chunk = ( numBytes > OUTPUT_LENGTH_MAX ) ? OUTPUT_LENGTH_MAX : (FS_Console_OutputLength_t)numBytes;
+    output(buf, chunk);
+
+    buf += chunk;
+    numBytes -= chunk;
+  }
+}
+
+static void drainLoop(void * params)
+{
+  uint8_t core;
+  _Bool busy;
+
+  while(true)
+  {
+    busy = false;
+
+    for(core = 0; core < FS_CONSOLE_NUM_CORES; core++)
+    {
+      busy |= coreOutputRingDrain(&coreOutputRings[core]);
+    }
+
+    // Only sleep once every ring has been found empty.
+    if(!busy)
+    {
+      vTaskDelay(FS_CONSOLE_DRAIN_PERIOD_TICKS);
+    }
+  }
+}
+
 static void mainLoop(void * params)
 {
-  uint16_t tempInt;
+  consoleTask = xTaskGetCurrentTaskHandle();
 
   // Clear the screen.
   output( FS_CONSOLE_VT100_CLEAR_SCREEN, strlen( FS_CONSOLE_VT100_CLEAR_SCREEN ) );
@@ -212,18 +490,24 @@ static void mainLoop(void * params)
   output( FS_CONSOLE_SPLASH_SCREEN, strlen( FS_CONSOLE_SPLASH_SCREEN ) );
 
   // Print the prompt character prior to going in to the processing loop.
-  output(FS_CONSOLE_PROMPT_CHARACTER, 1);
+  output(FS_CONSOLE_PROMPT_CHARACTER, sizeof(FS_CONSOLE_PROMPT_CHARACTER) - 1);
+
+  if(supervisor)
+  {
+    heartbeatHandle = supervisor->registerTask("FS_Console", FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS);
+  }
 
   while(true)
   {
-    while(!inputLineAvailable());
+    waitForInputLine();
     executeCommand();
+    heartbeat();
 
     /*
     After the command actions have completed, output the prompt character
     ready for the next line.
     */
-    output(FS_CONSOLE_PROMPT_CHARACTER, 1);
+    output(FS_CONSOLE_PROMPT_CHARACTER, sizeof(FS_CONSOLE_PROMPT_CHARACTER) - 1);
 
     // Flush the input buffer.
     input.ptr = 0;
@@ -231,20 +515,57 @@ static void mainLoop(void * params)
 }
 
 
+static void waitForInputLine(void)
+{
+  while(!inputLineAvailable())
+  {
+    /*
+    Only sleep once the stream has run dry, so that bursts of input (pasted
+    text, a remote session) are consumed at full rate.
+    */
+    if(inputIdle)
+    {
+      heartbeat();
+      vTaskDelay(FS_CONSOLE_POLL_PERIOD_TICKS);
+    }
+  }
+
+  heartbeat();
+}
+
+static void heartbeat(void)
+{
+  if(supervisor)
+  {
+    supervisor->kick(heartbeatHandle);
+  }
+}
+
 static _Bool inputLineAvailable(void)
 {
   _Bool retVal;
   char tempByte, tempByte2;
+  const IOStreamSnapshot_t * streams;
+  FS_DT_IOStream_t * defaultIO;
+  unsigned int phase;
+
+  retVal = false;
+  inputIdle = true;
 
   /*
-  Another task may be attempting to modify the IO stream list so we must get the mutex
-  before doing anything with the streams.
+  Another task may be replacing the IO stream list, so read the default stream
+  through a snapshot which is guaranteed to stay valid until ioReadUnlock().
   */
-  if( xSemaphoreTake( io.mutex, FS_CONSOLE_IOSTREAM_MUTEX_TIMEOUT_TICKS ) )
+  streams = ioReadLock(&phase);
+  defaultIO = streams->interfaces[streams->defaultInterfaceIndex];
+
+  if(defaultIO)
   {
     // Get a byte from the default IO stream if one is available.
-    if( io.interfaces[io.defaultInterfaceIndex]->readBytes( &tempByte, 1 ) )
+    if( defaultIO->readBytes( &tempByte, 1 ) )
     {
+      inputIdle = false;
+
       if(echo)
       {
         output(&tempByte, 1);
@@ -293,46 +614,55 @@ static _Bool inputLineAvailable(void)
         retVal = true;
       }
     }
-
-    // Give the mutex back.
-    xSemaphoreGive(io.mutex);
   }
 
-  // Couldn't get the mutex.
-  else
-  {
-    retVal = false;
-  }
+  ioReadUnlock(phase);
 
   return retVal;
 }
 
-static void output(const char * buf, uint16_t numBytes)
+static void output(const char * buf, FS_Console_OutputLength_t numBytes)
 {
-  uint8_t i;
+  FS_Console_StreamIndex_t i;
+  const IOStreamSnapshot_t * streams;
+  unsigned int phase;
+
+  // A command streaming output is making progress, however long it runs.
+  if( consoleTask && ( xTaskGetCurrentTaskHandle() == consoleTask ) )
+  {
+    heartbeat();
+  }
+
+  streams = ioReadLock(&phase);
 
-  io.interfaces[io.defaultInterfaceIndex]->writeBytes(buf, numBytes);
+  if(streams->interfaces[streams->defaultInterfaceIndex])
+  {
+    streams->interfaces[streams->defaultInterfaceIndex]->writeBytes(buf, numBytes);
+  }
 
   if(echoToAllOutputStreams)
   {
     // Loop over all available output streams except the default and echo the output to each.
     for(i = 0; i < FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS; i++)
     {
-      if(i != io.defaultInterfaceIndex)
+      if(i != streams->defaultInterfaceIndex)
       {
-        if(io.interfaces[i])
+        if(streams->interfaces[i])
         {
-          io.interfaces[i]->writeBytes(buf, numBytes);
+          streams->interfaces[i]->writeBytes(buf, numBytes);
         }
       }
     }
   }
+
+  ioReadUnlock(phase);
 }
 
 static void executeCommand(void)
 {
-  uint16_t i, j;
-  _Bool commandExtracted;
+  FS_Console_InputIndex_t i;
+  FS_Console_CommandIndex_t j;
+  const char * args;
   FS_Console_CommandCallbackInterface_t callbackInterface;
   void(*callback)( const char * argv,
                    FS_Console_CommandCallbackInterface_t * callbackInterface );
@@ -342,36 +672,30 @@ static void executeCommand(void)
   my interpretation of the documentation, if the string to tokenise is not in
   dynamically allocated memory, neither function is thread-safe. Perhaps revisit
   this later.
-  */
-  commandExtracted = false;
 
-  for(i = 0; i <= input.ptr; i++)
+  inputLineAvailable() has already replaced the line ending at input.ptr with
+  a NULL terminator, and input.ptr is at most FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1,
+  so only the characters before it need scanning.
+  */
+  for(i = 0; i < input.ptr; i++)
   {
     if( ' ' == input.buffer[i] )
     {
-      // Replace the space character with a NULL terminator.
-      input.buffer[i] = 0;
-      commandExtracted = true;
       break;
     }
   }
 
-  /*
-  If we didn't encounter a space character, the entire input buffer is filled with a single token
-  and there are no arguments. Append a NULL terminator in order to use string functions.
-  */
-  if(!commandExtracted)
+  if(i < input.ptr)
   {
-    // If there's no room to append a NULL terminator, error!
-    if( ( FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1) == input.ptr )
-    {
-      doBufferOverwhelmedActions();
-    }
+    // Replace the space character with a NULL terminator; the arguments follow it.
+    input.buffer[i] = 0;
+    args = &input.buffer[i + 1];
+  }
 
-    else
-    {
-      input.buffer[input.ptr++] = 0;
-    }
+  else
+  {
+    // No space - the whole line is the command and the argument string is empty.
+    args = &input.buffer[input.ptr];
   }
 
   // Iterate over the command table looking for the first token:
@@ -390,7 +714,9 @@ static void executeCommand(void)
   if(callback)
   {
     callbackInterface.inputLineAvailable = inputLineAvailable;
+    callbackInterface.waitForInputLine = waitForInputLine;
     callbackInterface.output = output;
+    callbackInterface.heartbeat = heartbeat;
     callbackInterface.input = &input;
 
     /*
@@ -399,7 +725,7 @@ static void executeCommand(void)
     callback interface to allow the implementation function to receive
     further input.
     */
-    callback( &( input.buffer[i+1] ), &callbackInterface );
+    callback( args, &callbackInterface );
   }
 
   else
@@ -409,44 +735,186 @@ static void executeCommand(void)
 }
 
 static void doBufferOverwhelmedActions(void)
-
 {
-  output( "\r\n\nWARNING - Console input buffer was overwhelmed and will be flushed!!!\r\n\n"
-          FS_CONSOLE_PROMPT_CHARACTER,
-          76);
+  static const char overwhelmedMsg[] =
+    "\r\n\nWARNING - Console input buffer was overwhelmed and will be flushed!!!\r\n\n"
+    FS_CONSOLE_PROMPT_CHARACTER;
+
+  output( overwhelmedMsg, sizeof(overwhelmedMsg) - 1 );
   input.ptr = 0;
 }
 
 static void doBadCommandActions(void)
 {
-  output("Bad command - ", 14);
-  output(input.buffer, input.ptr + 1);
-  output("\r\n\r\n", 4);
+  static const char badCommandMsg[] = "Bad command - ";
+
+  output(badCommandMsg, sizeof(badCommandMsg) - 1);
+
+  // Only the command token; executeCommand() has terminated it.
+  output(input.buffer, strlen(input.buffer));
+  output("\r\n\r\n", sizeof("\r\n\r\n") - 1);
 
   // Flush the contents of the input buffer.
   input.ptr = 0;
 }
 
 
+/*
+Enter a read-side critical section on the IO stream list. Wait-free: never
+blocks and never retries. The returned snapshot must not be used after the
+matching ioReadUnlock(). Sections may nest.
+*/
+static const IOStreamSnapshot_t * ioReadLock(unsigned int * phase)
+{
+  *phase = atomic_load(&io.phase) & 1;
+  atomic_fetch_add(&io.readers[*phase], 1);
+
+  return atomic_load(&io.current);
+}
+
+static void ioReadUnlock(unsigned int phase)
+{
+  atomic_fetch_sub(&io.readers[phase], 1);
+}
+
+/*
+Start modifying the IO stream list. Returns the spare snapshot pre-loaded with
+a copy of the published one. Must be followed by ioWriteCommit(), and must not
+be called from inside a read-side section (i.e. from a stream callback) as the
+grace period would never end.
+*/
+static IOStreamSnapshot_t * ioWriteBegin(void)
+{
+  IOStreamSnapshot_t * published;
+  IOStreamSnapshot_t * next;
+
+  xSemaphoreTake(io.mutex, portMAX_DELAY);
+
+  published = atomic_load(&io.current);
+  next = ( published == &io.snapshots[0] ) ? &io.snapshots[1] : &io.snapshots[0];
+  memcpy(next, published, sizeof(IOStreamSnapshot_t));
+
+  return next;
+}
+
+static void ioWriteCommit(IOStreamSnapshot_t * next)
+{
+  unsigned int i, oldPhase;
+
+  atomic_store(&io.current, next);
+
+  /*
+  Grace period. New readers are steered to the other phase counter so that
+  the one being waited on can only fall. Two flips are needed because a
+  reader may have sampled the phase just before the first flip and so count
+  itself in to the phase we waited on first after it has drained.
+  */
+  for(i = 0; i < 2; i++)
+  {
+    oldPhase = atomic_fetch_xor(&io.phase, 1) & 1;
+
+    while( atomic_load(&io.readers[oldPhase]) )
+    {
+      vTaskDelay(1);
+    }
+  }
+
+  // No reader can still hold the previous snapshot; it is now the spare.
+  xSemaphoreGive(io.mutex);
+}
+
 // Callback functions.
 static void addIOStreamCallback(FS_DT_IOStream_t * newIO)
 {
-  // Must make the new stream be used for tx and (if the 'echo to all' flag
-  // is set, echo rx to all stored streams).
+  FS_Console_StreamIndex_t i, freeIndex;
+  IOStreamSnapshot_t * next;
+  FS_DT_IOStream_t * oldDefaultIO;
+  static const char outputOnlyMsg[] =
+    "\r\n\nAnother console session has arrived - this stream is now output only.\r\n\n";
+
+  next = ioWriteBegin();
+  freeIndex = FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS;
+
+  for(i = 0; i < FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS; i++)
+  {
+    // Already stored, nothing to do.
+    if(next->interfaces[i] == newIO)
+    {
+      freeIndex = FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS;
+      break;
+    }
+
+    if( !next->interfaces[i] && ( FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS == freeIndex ) )
+    {
+      freeIndex = i;
+    }
+  }
+
+  oldDefaultIO = next->interfaces[next->defaultInterfaceIndex];
 
-  // Output 'this stream is now output only as another console session has arrived' message to non-default streams.
+  // The new stream becomes the default for input; the rest remain for output.
+  if(freeIndex < FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS)
+  {
+    next->interfaces[freeIndex] = newIO;
+    next->defaultInterfaceIndex = freeIndex;
+
+    /*
+    Tell the old default before the commit releases the writer mutex, so that
+    a concurrent removeIOStreamCallback() for it cannot return in between.
+    */
+    if(oldDefaultIO)
+    {
+      oldDefaultIO->writeBytes(outputOnlyMsg, sizeof(outputOnlyMsg) - 1);
+    }
+  }
+
+  ioWriteCommit(next);
 }
 
 
 static void removeIOStreamCallback(FS_DT_IOStream_t * oldIO)
 {
+  FS_Console_StreamIndex_t i;
+  IOStreamSnapshot_t * next;
+
+  next = ioWriteBegin();
+
+  for(i = 0; i < FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS; i++)
+  {
+    if(next->interfaces[i] == oldIO)
+    {
+      next->interfaces[i] = NULL;
+    }
+  }
+
+  // If the default stream went away, fall back to the first remaining one.
+  if( !next->interfaces[next->defaultInterfaceIndex] )
+  {
+    for(i = 0; i < FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS; i++)
+    {
+      if(next->interfaces[i])
+      {
+        next->defaultInterfaceIndex = i;
+        break;
+      }
+    }
+  }
 
+  /*
+  Once this returns no console reader holds oldIO any longer, so the caller
+  is free to tear the stream down.
+  */
+  ioWriteCommit(next);
 }
 
 // Built in commands.
 static void help(const char * argv, FS_Console_CommandCallbackInterface_t * console)
 {
-  int16_t i;
+  FS_Console_CommandIndex_t i;
+  static const char headerMsg[] = "\r\nAvailable Commands: \r\n\n";
+  static const char footerMsg[] =
+    "\r\n - Type a command name and hit <Enter> for further information. "
+    "\r\n - Type \'exit\' and hit <Enter> to quit.\r\n\n";
 
   // If arguments were supplied, we need to supply help for a particular command.
   if(strlen(argv))
@@ -457,20 +925,19 @@ static void help(const char * argv, FS_Console_CommandCallbackInterface_t * cons
   // If no arguments were supplied, output generic help text for the system.
   else
   {
-    console->output("\r\nAvailable Commands: \r\n\n", 27);
+    console->output(headerMsg, sizeof(headerMsg) - 1);
 
     for(i = 0; i < numRegisteredCommands; i++)
     {
       console->output(commandTable[i].cmd, strlen(commandTable[i].cmd));
-      console->output("\r\n", 2);
+      console->output("\r\n", sizeof("\r\n") - 1);
     }
 
-    console->output("\r\n - Type a command name and hit <Enter> for further information. ", 65);
-    console->output("\r\n - Type \'exit\' and hit <Enter> to quit.\r\n\n", 44);
+    console->output(footerMsg, sizeof(footerMsg) - 1);
 
     // Flush the console input buffer and then wait for a line.
     console->input->ptr = 0;
-    while( !console->inputLineAvailable() );
+    console->waitForInputLine();
 
     // If the input line wasn't 'exit'
     if(strcmp(console->input->buffer, "exit"))
@@ -481,14 +948,14 @@ static void help(const char * argv, FS_Console_CommandCallbackInterface_t * cons
         {
           output( commandTable[i].helpString,
                   strlen( commandTable[i].helpString ) );
-          output("\r\n\n", 3);
+          output("\r\n\n", sizeof("\r\n\n") - 1);
         }
       }
     }
 
     else
     {
-      output("\r\n", 2);
+      output("\r\n", sizeof("\r\n") - 1);
     }
   }
 
@@ -0,0 +1,166 @@
+/*
+Builds FS_Console at one point of the configuration matrix (see
+CMakeLists.txt) and checks that the index types were sized to match, and that
+the input, command table, IO stream list and output rings all work right up
+to their configured limits.
+*/
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#include <stdlib.h>
+
+_Static_assert( sizeof(FS_Console_InputIndex_t) == EXPECTED_INDEX_BYTES,
+                "FS_Console_InputIndex_t sized incorrectly" );
+_Static_assert( sizeof(FS_Console_CommandIndex_t) == EXPECTED_INDEX_BYTES,
+                "FS_Console_CommandIndex_t sized incorrectly" );
+_Static_assert( sizeof(FS_Console_StreamIndex_t) == EXPECTED_INDEX_BYTES,
+                "FS_Console_StreamIndex_t sized incorrectly" );
+_Static_assert( sizeof(FS_Console_OutputLength_t) >= 2,
+                "FS_Console_OutputLength_t narrower than 16 bits" );
+
+static const char * lastArgs;
+static unsigned int numCalls;
+
+static void testCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  lastArgs = argv;
+  numCalls++;
+}
+
+// Feeds a line in and executes it the way mainLoop() does.
+static _Bool runLine(const char * line, size_t length)
+{
+  size_t i;
+
+  testInputSet(line, length);
+
+  for(i = 0; i <= length; i++)
+  {
+    if( inputLineAvailable() )
+    {
+      executeCommand();
+      input.ptr = 0;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static uint32_t secondOutputBytes;
+
+static uint32_t secondWriteBytes(const char * buf, uint32_t numBytes)
+{
+  secondOutputBytes += numBytes;
+  return numBytes;
+}
+
+static uint32_t noReadBytes(char * buf, uint32_t numBytes)
+{
+  return 0;
+}
+
+int main(void)
+{
+  FS_Console_t console;
+  FS_Console_InitReturnsStruct_t returns;
+  FS_DT_IOStream_t secondIO = { noReadBytes, secondWriteBytes };
+  char * line;
+  char * longestCommand;
+  char * message;
+  size_t i, registered, numQueued, length;
+
+  CHECK( testConsoleInit(&console, &testIO, NULL, &returns) );
+  echoToAllOutputStreams = true;
+
+  line = malloc(FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES + 1);
+
+  // The longest command that fits: every byte but the one for the terminator.
+  longestCommand = malloc(FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES);
+  memset(longestCommand, 'x', FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1);
+  longestCommand[FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1] = 0;
+  CHECK( console.registerCommand(longestCommand, testCommand, "") );
+
+  memcpy(line, longestCommand, FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1);
+  line[FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES - 1] = FS_CONSOLE_LINE_ENDING;
+  CHECK( runLine(line, FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES) );
+  CHECK(1 == numCalls);
+  CHECK(lastArgs && !strcmp(lastArgs, ""));
+
+  // One byte more without a line ending overwhelms the buffer.
+  testOutputClear();
+  memset(line, 'y', FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES);
+  CHECK( !runLine(line, FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES) );
+  CHECK( testOutputContains("overwhelmed") );
+  CHECK(0 == input.ptr);
+
+  if(FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES >= 8)
+  {
+    // "x a b" only matches if the longest command is a single 'x'.
+    CHECK( console.registerCommand("x", testCommand, "") || ( FS_CONSOLE_MAX_NUM_COMMANDS < 3 ) );
+    CHECK( runLine("x a b\r", 6) );
+    CHECK(lastArgs && !strcmp(lastArgs, "a b"));
+
+    testOutputClear();
+    CHECK( runLine("zz\r", 3) );
+    CHECK( testOutputContains("Bad command - zz\r\n") );
+  }
+
+  // Fill the command table; the registration after the last slot must fail.
+  registered = numRegisteredCommands;
+
+  for(i = registered; i < FS_CONSOLE_MAX_NUM_COMMANDS; i++)
+  {
+    CHECK( console.registerCommand("filler", testCommand, "") );
+  }
+
+  CHECK(FS_CONSOLE_MAX_NUM_COMMANDS == numRegisteredCommands);
+  CHECK( !console.registerCommand("overflow", testCommand, "") );
+
+  // A second stream takes over input; output goes to both until it is removed.
+  returns.addIOStreamCallback(&secondIO);
+  testOutputClear();
+  secondOutputBytes = 0;
+  output("abc", 3);
+  CHECK(3 == testOutput.length);
+  CHECK(3 == secondOutputBytes);
+
+  returns.removeIOStreamCallback(&secondIO);
+  testOutputClear();
+  secondOutputBytes = 0;
+  output("abc", 3);
+  CHECK(3 == testOutput.length);
+  CHECK(0 == secondOutputBytes);
+
+  // A full per-core ring drains completely, however its length compares to output()'s.
+  message = malloc(FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES);
+  memset(message, 'z', FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES);
+  numQueued = 0;
+
+  while( numQueued < FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES - 1 )
+  {
+    length = FS_CONSOLE_CORE_OUTPUT_RING_LENGTH_BYTES - 1 - numQueued;
+
+    if(length > FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES)
+    {
+      length = FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES;
+    }
+
+    coreOutputRingWrite(message, (FS_Console_OutputLength_t)length);
+    numQueued += length;
+  }
+
+  CHECK( 0 == atomic_load(&coreOutputRings[0].droppedBytes) );
+
+  testOutputClear();
+  CHECK( coreOutputRingDrain(&coreOutputRings[0]) );
+  CHECK(numQueued == testOutput.length + testOutput.overflow);
+  CHECK( !coreOutputRingDrain(&coreOutputRings[0]) );
+
+  free(message);
+  free(line);
+  free(longestCommand);
+
+  return TEST_RESULT();
+}
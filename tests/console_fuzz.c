@@ -0,0 +1,243 @@
+/*
+Fuzz target for the console: line assembly, command parsing and every
+built-in command (help, log, boot, health) with the input under the fuzzer's
+control.
+
+Built with clang and -fsanitize=fuzzer (FS_TEST_LIBFUZZER defined) this is a
+libFuzzer target. Otherwise main() below replays the files named on the
+command line or, given none, a fixed set of generated inputs so that ctest can
+run it under AddressSanitizer and UndefinedBehaviorSanitizer.
+*/
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#include "FS_Filesystem_Stdio.h"
+#include "FS_LogStore.h"
+#include "FS_Logging.h"
+#include "FS_Supervisor.h"
+#include "FS_System.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FUZZ_DEFAULT_ITERATIONS 20000
+#define FUZZ_MAX_GENERATED_LENGTH 512
+
+static volatile uint64_t fuzzTimeMicroseconds;
+static FS_Console_t fuzzConsole;
+static FS_Logging_t fuzzLogging;
+static FS_Supervisor_t fuzzSupervisor;
+static FS_Filesystem_t fuzzFs;
+static char logStorePath[] = "/tmp/fs_console_fuzz_XXXXXX";
+
+static int16_t excRegisterModule(const char * description, void(*fatalHandlerCallback)(void))
+{
+  return 0;
+}
+
+static void excRaise(int16_t moduleLabel, const char * fmt, ...)
+{
+}
+
+static FS_Exception_t fuzzExc = { excRegisterModule, excRaise, excRaise };
+
+static void bootCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  FS_System_PrintBootTimeline(fuzzConsole.printf);
+}
+
+static void healthCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  FS_Supervisor_PrintReport(fuzzConsole.printf);
+}
+
+static void removeLogStore(void)
+{
+  unlink(logStorePath);
+}
+
+// Brings the modules up the way FS_System_Init() does, minus the tasks.
+static void setUp(void)
+{
+  FS_Console_InitReturnsStruct_t consoleReturns;
+  FS_Supervisor_InitStruct_t supervisorInit;
+  FS_Supervisor_InitReturnsStruct_t supervisorReturns;
+  FS_LogStore_InitStruct_t logStoreInit;
+  FS_Logging_InitStruct_t loggingInit;
+  FS_Logging_InitReturnsStruct_t loggingReturns;
+  int fd;
+
+  FS_Supervisor_InitStructInit(&supervisorInit);
+  FS_Supervisor_InitReturnsStructInit(&supervisorReturns);
+  supervisorInit.instance = &fuzzSupervisor;
+  supervisorInit.exc = &fuzzExc;
+  supervisorInit.timeMicroseconds = &fuzzTimeMicroseconds;
+  FS_Supervisor_Init(&supervisorInit, &supervisorReturns);
+
+  testConsoleInit(&fuzzConsole, &testIO, &fuzzSupervisor, &consoleReturns);
+  echo = true;
+
+  // mainLoop() would do this on start up.
+  heartbeatHandle = fuzzSupervisor.registerTask("FS_Console", FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS);
+
+  fuzzConsole.registerCommand("boot", bootCommand, "");
+  fuzzConsole.registerCommand("health", healthCommand, "");
+
+  fd = mkstemp(logStorePath);
+  close(fd);
+  atexit(removeLogStore);
+
+  FS_Filesystem_StdioInit(&fuzzFs);
+  FS_LogStore_InitStructInit(&logStoreInit);
+  logStoreInit.fs = &fuzzFs;
+  logStoreInit.path = logStorePath;
+  logStoreInit.sizeBytes = 16384;
+  logStoreInit.sectorSizeBytes = 1024;
+  FS_LogStore_Init(&logStoreInit);
+
+  FS_Logging_InitStructInit(&loggingInit);
+  FS_Logging_InitReturnsStructInit(&loggingReturns);
+  loggingInit.instance = &fuzzLogging;
+  loggingInit.console = &fuzzConsole;
+  loggingInit.timeMicroseconds = &fuzzTimeMicroseconds;
+  FS_Logging_Init(&loggingInit, &loggingReturns);
+
+  // Without the writer task, put records in the store directly for 'log show'.
+  FS_LogStore_Append(fuzzTimeMicroseconds, "first record\r\n", 14);
+  fuzzTimeMicroseconds += 5000000;
+  FS_LogStore_Append(fuzzTimeMicroseconds, "second record\r\n", 15);
+}
+
+static void drainOutput(void)
+{
+  while( coreOutputRingDrain(&coreOutputRings[0]) );
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+  static _Bool initialised;
+
+  if(!initialised)
+  {
+    setUp();
+    initialised = true;
+  }
+
+  testOutputClear();
+  testInputSet( (const char *)data, size );
+
+  // Commands which wait for more input (help) get line endings once the data runs out.
+  testInput.fallback = FS_CONSOLE_LINE_ENDING;
+  input.ptr = 0;
+
+  while(testInput.pos < testInput.length)
+  {
+    if( inputLineAvailable() )
+    {
+      executeCommand();
+      input.ptr = 0;
+    }
+
+    drainOutput();
+
+    if(input.ptr >= FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES)
+    {
+      abort();
+    }
+  }
+
+  fuzzTimeMicroseconds += 1000;
+
+  return 0;
+}
+
+#ifndef FS_TEST_LIBFUZZER
+
+static uint32_t prngState = 0x12345678;
+
+static uint32_t prng(void)
+{
+  prngState ^= prngState << 13;
+  prngState ^= prngState >> 17;
+  prngState ^= prngState << 5;
+
+  return prngState;
+}
+
+// Builds an input out of command fragments, separators and random bytes.
+static size_t generateInput(char * buf, size_t capacity)
+{
+  static const char * fragments[] =
+  {
+    "help", "log", "show", "--since", "999999999999", "boot", "health", "exit",
+    " ", " ", "\r", "\r", "\n", "\b",
+  };
+  size_t length, n;
+  uint32_t r;
+
+  length = 0;
+
+  while( ( length < capacity ) && ( prng() % 16 ) )
+  {
+    r = prng() % ( sizeof(fragments) / sizeof(fragments[0]) + 2 );
+
+    if( r < sizeof(fragments) / sizeof(fragments[0]) )
+    {
+      n = strlen(fragments[r]);
+
+      if(n > capacity - length)
+      {
+        n = capacity - length;
+      }
+
+      memcpy(&buf[length], fragments[r], n);
+      length += n;
+    }
+
+    else
+    {
+      buf[length++] = (char)prng();
+    }
+  }
+
+  return length;
+}
+
+int main(int argc, char ** argv)
+{
+  static char buf[FUZZ_MAX_GENERATED_LENGTH];
+  FILE * f;
+  size_t length;
+  int i;
+
+  if(argc > 1)
+  {
+    for(i = 1; i < argc; i++)
+    {
+      f = fopen(argv[i], "rb");
+
+      if(!f)
+      {
+        perror(argv[i]);
+        return 1;
+      }
+
+      length = fread(buf, 1, sizeof(buf), f);
+      fclose(f);
+      LLVMFuzzerTestOneInput( (const uint8_t *)buf, length );
+    }
+
+    return 0;
+  }
+
+  for(i = 0; i < FUZZ_DEFAULT_ITERATIONS; i++)
+  {
+    length = generateInput(buf, sizeof(buf));
+    LLVMFuzzerTestOneInput( (const uint8_t *)buf, length );
+  }
+
+  return 0;
+}
+
+#endif // FS_TEST_LIBFUZZER
@@ -0,0 +1,111 @@
+/*
+The console task's heartbeat during long running commands. A command which
+keeps writing output, or calls heartbeat(), must never be reported as stalled
+however long it runs; one which does neither must be.
+*/
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#define STEP_MICROSECONDS ( FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS / 4 )
+#define COMMAND_STEPS 40 // Ten heartbeat deadlines.
+
+static volatile uint64_t timeMicroseconds;
+static FS_Supervisor_t supervisorInstance;
+static FS_Supervisor_InitReturnsStruct_t supervisorReturns;
+
+// One step of a long running command: time passes and the timer ticks.
+static void step(void)
+{
+  timeMicroseconds += STEP_MICROSECONDS;
+  supervisorReturns.tick();
+}
+
+static void streamingCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  int i;
+
+  for(i = 0; i < COMMAND_STEPS; i++)
+  {
+    step();
+    console->output(".", 1);
+  }
+}
+
+static void printingCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  int i;
+
+  for(i = 0; i < COMMAND_STEPS; i++)
+  {
+    step();
+    consolePrintf("line %d\r\n", i);
+  }
+}
+
+static void silentCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  int i;
+
+  for(i = 0; i < COMMAND_STEPS; i++)
+  {
+    step();
+    console->heartbeat();
+  }
+}
+
+static void hungCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  int i;
+
+  for(i = 0; i < COMMAND_STEPS; i++)
+  {
+    step();
+  }
+}
+
+static void runCommand(const char * line)
+{
+  testInputSet(line, strlen(line));
+
+  while( !inputLineAvailable() );
+
+  executeCommand();
+  input.ptr = 0;
+}
+
+int main(void)
+{
+  FS_Console_t console;
+  FS_Console_InitReturnsStruct_t returns;
+  FS_Supervisor_InitStruct_t supervisorInit;
+  FS_Supervisor_StallRecord_t stall;
+
+  FS_Supervisor_InitStructInit(&supervisorInit);
+  FS_Supervisor_InitReturnsStructInit(&supervisorReturns);
+  supervisorInit.instance = &supervisorInstance;
+  supervisorInit.timeMicroseconds = &timeMicroseconds;
+  FS_Supervisor_Init(&supervisorInit, &supervisorReturns);
+
+  testConsoleInit(&console, &testIO, &supervisorInstance, &returns);
+
+  console.registerCommand("stream", streamingCommand, "");
+  console.registerCommand("print", printingCommand, "");
+  console.registerCommand("silent", silentCommand, "");
+  console.registerCommand("hung", hungCommand, "");
+
+  // Stand in for mainLoop(): this thread is now the console task.
+  consoleTask = xTaskGetCurrentTaskHandle();
+  heartbeatHandle = supervisorInstance.registerTask("FS_Console", FS_CONSOLE_HEARTBEAT_DEADLINE_MICROSECONDS);
+
+  runCommand("stream\r");
+  runCommand("print\r");
+  runCommand("silent\r");
+  CHECK( !FS_Supervisor_GetLastFatalStall(&stall) );
+
+  runCommand("hung\r");
+  CHECK( FS_Supervisor_GetLastFatalStall(&stall) );
+  CHECK( stall.name && !strcmp(stall.name, "FS_Console") );
+
+  return TEST_RESULT();
+}
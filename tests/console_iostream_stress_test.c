@@ -0,0 +1,211 @@
+/*
+Stress test for the IO stream list, built with ThreadSanitizer. Several tasks
+attach and detach their own streams while others write output and poll for
+input as fast as they can. Besides any race TSan reports, a stream must never
+be called once removeIOStreamCallback() for it has returned. A deterministic
+case first covers the notice sent to the old default stream when a new one
+is attached.
+*/
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define NUM_ATTACHERS 4
+#define NUM_WRITERS 3
+#define ATTACH_CYCLES 2000
+
+static FS_Console_InitReturnsStruct_t returns;
+static atomic_bool attached[NUM_ATTACHERS];
+static atomic_uint lateCalls;
+static atomic_bool running;
+
+static void checkAttached(int stream)
+{
+  if( !atomic_load(&attached[stream]) )
+  {
+    atomic_fetch_add(&lateCalls, 1);
+  }
+}
+
+#define STREAM_FUNCTIONS(n) \
+  static uint32_t readBytes##n(char * buf, uint32_t numBytes) \
+  { \
+    checkAttached(n); \
+    return 0; \
+  } \
+  static uint32_t writeBytes##n(const char * buf, uint32_t numBytes) \
+  { \
+    checkAttached(n); \
+    return numBytes; \
+  }
+
+STREAM_FUNCTIONS(0)
+STREAM_FUNCTIONS(1)
+STREAM_FUNCTIONS(2)
+STREAM_FUNCTIONS(3)
+
+static FS_DT_IOStream_t streams[NUM_ATTACHERS] =
+{
+  { readBytes0, writeBytes0 },
+  { readBytes1, writeBytes1 },
+  { readBytes2, writeBytes2 },
+  { readBytes3, writeBytes3 },
+};
+
+static uint32_t discardWriteBytes(const char * buf, uint32_t numBytes)
+{
+  return numBytes;
+}
+
+static uint32_t noReadBytes(char * buf, uint32_t numBytes)
+{
+  return 0;
+}
+
+static FS_DT_IOStream_t defaultIO = { noReadBytes, discardWriteBytes };
+
+/*
+The old default stream stalls in its writeBytes() while the main thread
+removes it; removal must not return before the write does.
+*/
+static atomic_bool noticeStarted;
+static atomic_bool removeReturned;
+static atomic_bool removedDuringNotice;
+
+static uint32_t slowNoticeWriteBytes(const char * buf, uint32_t numBytes)
+{
+  atomic_store(&noticeStarted, true);
+  usleep(100000);
+
+  if( atomic_load(&removeReturned) )
+  {
+    atomic_store(&removedDuringNotice, true);
+  }
+
+  return numBytes;
+}
+
+static FS_DT_IOStream_t slowNoticeIO = { noReadBytes, slowNoticeWriteBytes };
+static FS_DT_IOStream_t newSessionIO = { noReadBytes, discardWriteBytes };
+
+static void * newSessionAttacher(void * arg)
+{
+  returns.addIOStreamCallback(&newSessionIO);
+
+  return NULL;
+}
+
+static void testNoticeToRemovedStream(void)
+{
+  pthread_t thread;
+
+  returns.addIOStreamCallback(&slowNoticeIO);
+  pthread_create(&thread, NULL, newSessionAttacher, NULL);
+
+  while( !atomic_load(&noticeStarted) )
+  {
+    usleep(1000);
+  }
+
+  returns.removeIOStreamCallback(&slowNoticeIO);
+  atomic_store(&removeReturned, true);
+
+  pthread_join(thread, NULL);
+  returns.removeIOStreamCallback(&newSessionIO);
+
+  CHECK( !atomic_load(&removedDuringNotice) );
+}
+
+static void * attacher(void * arg)
+{
+  int stream = (int)(intptr_t)arg;
+  int i;
+
+  for(i = 0; i < ATTACH_CYCLES; i++)
+  {
+    atomic_store(&attached[stream], true);
+    returns.addIOStreamCallback(&streams[stream]);
+    returns.removeIOStreamCallback(&streams[stream]);
+
+    // No reader may still hold the stream now.
+    atomic_store(&attached[stream], false);
+  }
+
+  return NULL;
+}
+
+static void * writer(void * arg)
+{
+  static const char message[] = "stress test output\r\n";
+
+  while( atomic_load(&running) )
+  {
+    output(message, sizeof(message) - 1);
+  }
+
+  return NULL;
+}
+
+// Stands in for the console task, the only caller of inputLineAvailable().
+static void * poller(void * arg)
+{
+  while( atomic_load(&running) )
+  {
+    inputLineAvailable();
+  }
+
+  return NULL;
+}
+
+int main(void)
+{
+  FS_Console_t console;
+  pthread_t attachers[NUM_ATTACHERS];
+  pthread_t writers[NUM_WRITERS];
+  pthread_t pollerThread;
+  int i;
+
+  testConsoleInit(&console, &defaultIO, NULL, &returns);
+  echoToAllOutputStreams = true;
+
+  testNoticeToRemovedStream();
+
+  atomic_store(&running, true);
+
+  for(i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_create(&writers[i], NULL, writer, NULL);
+  }
+
+  pthread_create(&pollerThread, NULL, poller, NULL);
+
+  for(i = 0; i < NUM_ATTACHERS; i++)
+  {
+    pthread_create( &attachers[i], NULL, attacher, (void *)(intptr_t)i );
+  }
+
+  for(i = 0; i < NUM_ATTACHERS; i++)
+  {
+    pthread_join(attachers[i], NULL);
+  }
+
+  atomic_store(&running, false);
+
+  for(i = 0; i < NUM_WRITERS; i++)
+  {
+    pthread_join(writers[i], NULL);
+  }
+
+  pthread_join(pollerThread, NULL);
+
+  CHECK(0 == atomic_load(&lateCalls));
+
+  // Only the default stream is left.
+  CHECK(&defaultIO == atomic_load(&io.current)->interfaces[atomic_load(&io.current)->defaultInterfaceIndex]);
+
+  return TEST_RESULT();
+}
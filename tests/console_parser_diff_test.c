@@ -0,0 +1,189 @@
+/*
+Differential test of the console's line assembly and command parsing against
+an independent reference model. Random inputs over a small alphabet (so that
+command names, separators, line endings, NULs and buffer overflows are all
+common) are fed to both, and the console's output must match the model's
+byte for byte.
+*/
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#include <stdlib.h>
+
+#define DIFF_ITERATIONS 20000
+#define DIFF_MAX_INPUT_LENGTH ( 4 * FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES )
+
+// Excludes 'l' and 'p' so that "help" can never be typed and wait for input.
+static const char alphabet[] = "e abcdfgh\r\r\0";
+
+static const char * const commandNames[] = { "e", "abcdefg", "e" };
+
+static void recordCommand(const char * argv, FS_Console_CommandCallbackInterface_t * console)
+{
+  console->output("<", 1);
+  console->output(argv, strlen(argv));
+  console->output(">", 1);
+}
+
+/*
+Reference model. Rather than mirror the console's byte-at-a-time state
+machine, it splits the input in to lines and works on each line as a whole.
+*/
+typedef struct
+{
+  char buffer[DIFF_MAX_INPUT_LENGTH * 80 + 256];
+  size_t length;
+
+}Model_t;
+
+static void modelAppend(Model_t * model, const char * s, size_t n)
+{
+  memcpy(&model->buffer[model->length], s, n);
+  model->length += n;
+}
+
+static void modelLine(Model_t * model, const char * line, size_t n)
+{
+  const char * space;
+  size_t tokenLength, argsLength, i;
+  char token[FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES];
+  const char * args;
+
+  // The command is everything before the first space, read as a C string.
+  space = memchr(line, ' ', n);
+  tokenLength = space ? (size_t)( space - line ) : n;
+  memcpy(token, line, tokenLength);
+  token[tokenLength] = 0;
+
+  // The arguments are everything after it, also read as a C string.
+  args = space ? space + 1 : "";
+  argsLength = space ? strnlen(args, n - tokenLength - 1) : 0;
+
+  for(i = 0; i < sizeof(commandNames) / sizeof(commandNames[0]); i++)
+  {
+    if( !strcmp(token, commandNames[i]) )
+    {
+      modelAppend(model, "<", 1);
+      modelAppend(model, args, argsLength);
+      modelAppend(model, ">", 1);
+      return;
+    }
+  }
+
+  modelAppend(model, "Bad command - ", 14);
+  modelAppend(model, token, strlen(token));
+  modelAppend(model, "\r\n\r\n", 4);
+}
+
+static void modelRun(Model_t * model, const char * data, size_t n)
+{
+  static const char overwhelmedMsg[] =
+    "\r\n\nWARNING - Console input buffer was overwhelmed and will be flushed!!!\r\n\n"
+    FS_CONSOLE_PROMPT_CHARACTER;
+  size_t start, end;
+
+  model->length = 0;
+  start = 0;
+
+  while(start < n)
+  {
+    end = start;
+
+    while( ( end < n ) && ( FS_CONSOLE_LINE_ENDING != data[end] ) )
+    {
+      end++;
+    }
+
+    /*
+    A line which reaches the end of the buffer without a line ending is thrown
+    away, byte that overflowed it included, and assembly starts again.
+    */
+    if( ( end - start ) >= FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES )
+    {
+      modelAppend(model, overwhelmedMsg, sizeof(overwhelmedMsg) - 1);
+      start += FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES;
+      continue;
+    }
+
+    // An unterminated tail is still being assembled; it produces nothing yet.
+    if(end == n)
+    {
+      break;
+    }
+
+    modelLine(model, &data[start], end - start);
+    start = end + 1;
+  }
+}
+
+static uint32_t prngState = 0x2468ace1;
+
+static uint32_t prng(void)
+{
+  prngState ^= prngState << 13;
+  prngState ^= prngState >> 17;
+  prngState ^= prngState << 5;
+
+  return prngState;
+}
+
+int main(void)
+{
+  FS_Console_t console;
+  FS_Console_InitReturnsStruct_t returns;
+  static char data[DIFF_MAX_INPUT_LENGTH];
+  static Model_t model;
+  size_t length, i, j;
+  unsigned int mismatches;
+
+  testConsoleInit(&console, &testIO, NULL, &returns);
+
+  for(i = 0; i < sizeof(commandNames) / sizeof(commandNames[0]); i++)
+  {
+    console.registerCommand(commandNames[i], recordCommand, "");
+  }
+
+  mismatches = 0;
+
+  for(i = 0; i < DIFF_ITERATIONS; i++)
+  {
+    length = prng() % ( DIFF_MAX_INPUT_LENGTH + 1 );
+
+    for(j = 0; j < length; j++)
+    {
+      data[j] = alphabet[ prng() % ( sizeof(alphabet) - 1 ) ];
+    }
+
+    testOutputClear();
+    testInputSet(data, length);
+    input.ptr = 0;
+
+    while(testInput.pos < testInput.length)
+    {
+      if( inputLineAvailable() )
+      {
+        executeCommand();
+        input.ptr = 0;
+      }
+    }
+
+    modelRun(&model, data, length);
+
+    if( ( testOutput.length != model.length )
+        || memcmp(testOutput.buffer, model.buffer, model.length) )
+    {
+      if(!mismatches)
+      {
+        fprintf(stderr, "mismatch on input %zu (%zu bytes): console %zu bytes, model %zu bytes\n",
+                i, length, testOutput.length, model.length);
+      }
+
+      mismatches++;
+    }
+  }
+
+  CHECK(0 == mismatches);
+
+  return TEST_RESULT();
+}
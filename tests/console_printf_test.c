@@ -0,0 +1,241 @@
+/*
+printf() from the console task (command callbacks) must be written out
+synchronously, ahead of the prompt; printf() from any other task goes through
+the per-core rings. The second half measures ring throughput with one pinned
+producer thread per CPU and checks that every byte is either delivered or
+reported as dropped.
+*/
+#define _GNU_SOURCE
+
+#include "test_common.h"
+
+#include "fs_console.c"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPORT_LINES 200
+#define THROUGHPUT_RUN_MILLISECONDS 200
+#define MAX_PRODUCERS FS_CONSOLE_NUM_CORES
+
+static FS_Console_t console;
+static FS_Console_InitReturnsStruct_t returnsForThroughput;
+
+static void reportCommand(const char * argv, FS_Console_CommandCallbackInterface_t * consoleInterface)
+{
+  int i;
+
+  // Far more than one ring holds.
+  for(i = 0; i < REPORT_LINES; i++)
+  {
+    console.printf("report line %03d ..................................\r\n", i);
+  }
+}
+
+static void * otherTaskPrintf(void * arg)
+{
+  console.printf("from another task\r\n");
+  return NULL;
+}
+
+static void testConsoleTaskPrintf(void)
+{
+  char expected[64];
+  pthread_t thread;
+  size_t length;
+
+  // Stand in for mainLoop(): this thread is now the console task.
+  consoleTask = xTaskGetCurrentTaskHandle();
+
+  console.registerCommand("report", reportCommand, "");
+
+  testOutputClear();
+  testInputSet("report\r", 7);
+
+  while( !inputLineAvailable() );
+
+  executeCommand();
+  output(FS_CONSOLE_PROMPT_CHARACTER, sizeof(FS_CONSOLE_PROMPT_CHARACTER) - 1);
+
+  // Every line arrived, in order, before the prompt, and nothing was queued.
+  snprintf(expected, sizeof(expected), "report line %03d ..................................\r\n", REPORT_LINES - 1);
+  length = strlen(expected);
+  CHECK(testOutput.length == REPORT_LINES * length + 1);
+  CHECK( !memcmp(&testOutput.buffer[testOutput.length - 1 - length], expected, length) );
+  CHECK('>' == testOutput.buffer[testOutput.length - 1]);
+  CHECK( !coreOutputRingDrain(&coreOutputRings[0]) );
+
+  // Other tasks still go through the ring.
+  testOutputClear();
+  pthread_create(&thread, NULL, otherTaskPrintf, NULL);
+  pthread_join(thread, NULL);
+  CHECK(0 == testOutput.length);
+
+  while( coreOutputRingDrain(&coreOutputRings[0]) );
+
+  CHECK( testOutputContains("from another task\r\n") );
+
+  consoleTask = NULL;
+}
+
+/*------------------------------------------------------------------------------
+Throughput. The drain task runs for real, writing to a stream which counts
+payload bytes and parses the dropped byte reports.
+------------------------------------------------------------------------------*/
+
+static atomic_ulong deliveredBytes;
+static atomic_ulong droppedBytes;
+static atomic_ulong producedBytes;
+static atomic_bool running;
+
+static uint32_t countingWriteBytes(const char * buf, uint32_t numBytes)
+{
+  static const char droppedPrefix[] = "\r\n[console: ";
+  unsigned int dropped;
+
+  // The drain task writes each dropped report with a single output() call.
+  if( ( numBytes >= sizeof(droppedPrefix) - 1 )
+      && !memcmp(buf, droppedPrefix, sizeof(droppedPrefix) - 1)
+      && ( 1 == sscanf(buf + sizeof(droppedPrefix) - 1, "%u", &dropped) ) )
+  {
+    atomic_fetch_add(&droppedBytes, dropped);
+  }
+
+  else
+  {
+    atomic_fetch_add(&deliveredBytes, numBytes);
+  }
+
+  return numBytes;
+}
+
+static uint32_t noReadBytes(char * buf, uint32_t numBytes)
+{
+  return 0;
+}
+
+static FS_DT_IOStream_t countingIO = { noReadBytes, countingWriteBytes };
+
+static void * producer(void * arg)
+{
+  static const char message[] = "0123456789abcdefghijklmnopqrstuvwxyz\r\n";
+  cpu_set_t cpus;
+  unsigned long produced;
+
+  // One producer per CPU, as on target there is one per core.
+  CPU_ZERO(&cpus);
+  CPU_SET( (int)(intptr_t)arg, &cpus );
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+  produced = 0;
+
+  while( atomic_load(&running) )
+  {
+    console.printf("%s", message);
+    produced += sizeof(message) - 1;
+  }
+
+  atomic_fetch_add(&producedBytes, produced);
+
+  return NULL;
+}
+
+static uint64_t nowMicroseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void testThroughput(void)
+{
+  pthread_t threads[MAX_PRODUCERS];
+  long numCpus;
+  int numProducers, i;
+  uint64_t start, elapsed;
+  unsigned long produced;
+
+  numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(numCpus > MAX_PRODUCERS)
+  {
+    numCpus = MAX_PRODUCERS;
+  }
+
+  returnsForThroughput.removeIOStreamCallback(&testIO);
+  returnsForThroughput.addIOStreamCallback(&countingIO);
+  xTaskCreate(drainLoop, "drain", 0, NULL, 0, NULL);
+
+  printf("producers  messages/s   delivered  dropped\n");
+
+  for(numProducers = 1; numProducers <= numCpus; numProducers *= 2)
+  {
+    atomic_store(&deliveredBytes, 0);
+    atomic_store(&droppedBytes, 0);
+    atomic_store(&producedBytes, 0);
+    atomic_store(&running, true);
+
+    start = nowMicroseconds();
+
+    for(i = 0; i < numProducers; i++)
+    {
+      pthread_create( &threads[i], NULL, producer, (void *)(intptr_t)i );
+    }
+
+    usleep(THROUGHPUT_RUN_MILLISECONDS * 1000);
+    atomic_store(&running, false);
+
+    for(i = 0; i < numProducers; i++)
+    {
+      pthread_join(threads[i], NULL);
+    }
+
+    elapsed = nowMicroseconds() - start;
+    produced = atomic_load(&producedBytes);
+
+    // Let the drain task catch up, then account for every byte.
+    for(i = 0; i < 5000; i++)
+    {
+      if( atomic_load(&deliveredBytes) + atomic_load(&droppedBytes) >= produced )
+      {
+        break;
+      }
+
+      usleep(1000);
+    }
+
+    CHECK( atomic_load(&deliveredBytes) + atomic_load(&droppedBytes) == produced );
+
+    printf( "%9d  %10.0f  %9.1f%%  %6.1f%%\n",
+            numProducers,
+            produced / 38.0 * 1000000.0 / elapsed,
+            100.0 * atomic_load(&deliveredBytes) / produced,
+            100.0 * atomic_load(&droppedBytes) / produced );
+  }
+}
+
+int main(void)
+{
+  cpu_set_t cpus;
+
+  /*
+  Start everything on CPU 0 so that the core ID used to index the rings is
+  always in range; the throughput producers then move to a CPU each.
+  */
+  CPU_ZERO(&cpus);
+  CPU_SET(0, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+  testConsoleInit(&console, &testIO, NULL, &returnsForThroughput);
+
+  testConsoleTaskPrintf();
+  testThroughput();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,143 @@
+/*
+FS_Logging with the store's writes held up in the writer task. Logging must
+not wait on the store, must keep lines in order, and once a core's queue is
+full must drop further lines and note how many.
+*/
+#include "test_common.h"
+
+#include "FS_Logging.c"
+
+#include "FS_Filesystem_Stdio.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static FS_Filesystem_t stdioFs;
+static FS_Filesystem_t heldFs;
+static FS_Logging_t logging;
+static FS_Logging_InitReturnsStruct_t returns;
+static volatile uint64_t simulatedMicroseconds;
+static pthread_t loggingThread;
+static char path[] = "/tmp/fs_logging_test_XXXXXX";
+
+static atomic_bool holdWrites;
+static atomic_bool writerHeld;
+static atomic_uint writesFromLoggingThread;
+
+// Writes from the writer task wait while holdWrites is set.
+static _Bool heldWrite(void * f, uint32_t offset, const void * buf, uint32_t numBytes)
+{
+  if( pthread_equal(pthread_self(), loggingThread) )
+  {
+    atomic_fetch_add(&writesFromLoggingThread, 1);
+  }
+
+  else
+  {
+    while( atomic_load(&holdWrites) )
+    {
+      atomic_store(&writerHeld, true);
+      usleep(1000);
+    }
+  }
+
+  return stdioFs.write(f, offset, buf, numBytes);
+}
+
+static char collected[4096];
+static uint32_t numCollected;
+
+static _Bool collect(const FS_LogStore_Record_t * record, void * context)
+{
+  strncat(collected, record->buf, record->numBytes);
+  numCollected++;
+
+  return true;
+}
+
+static void logLine(unsigned int i)
+{
+  simulatedMicroseconds += 1000;
+  logging.printf("line%u,", i);
+}
+
+int main(void)
+{
+  FS_LogStore_InitStruct_t storeInit;
+  FS_Logging_InitStruct_t init;
+  char expected[256];
+  unsigned int i;
+  int fd;
+
+  loggingThread = pthread_self();
+
+  fd = mkstemp(path);
+  close(fd);
+
+  FS_Filesystem_StdioInit(&stdioFs);
+  heldFs = stdioFs;
+  heldFs.write = heldWrite;
+
+  FS_LogStore_InitStructInit(&storeInit);
+  storeInit.fs = &heldFs;
+  storeInit.path = path;
+  storeInit.sizeBytes = 16384;
+  storeInit.sectorSizeBytes = 1024;
+  CHECK( FS_LogStore_Init(&storeInit) );
+
+  FS_Logging_InitStructInit(&init);
+  FS_Logging_InitReturnsStructInit(&returns);
+  init.instance = &logging;
+  init.timeMicroseconds = &simulatedMicroseconds;
+  FS_Logging_Init(&init, &returns);
+  CHECK(returns.success);
+  CHECK(returns.writerLoop);
+
+  // The writer task takes the first line and is then held up writing it.
+  atomic_store(&writesFromLoggingThread, 0);
+  atomic_store(&holdWrites, true);
+  xTaskCreate(returns.writerLoop, "FS_LogWriter", 0, NULL, 0, NULL);
+  logLine(0);
+
+  while( !atomic_load(&writerHeld) )
+  {
+    usleep(1000);
+  }
+
+  // The queue still holds line0's slot, so only QUEUE_LENGTH - 1 more fit.
+  for(i = 1; i < FS_LOGGING_QUEUE_LENGTH_RECORDS + 3; i++)
+  {
+    logLine(i);
+  }
+
+  CHECK(0 == atomic_load(&writesFromLoggingThread));
+  CHECK(3 == atomic_load(&coreQueues[0].droppedRecords));
+
+  // Once the store catches up, everything queued is written in order, then the note.
+  atomic_store(&holdWrites, false);
+
+  expected[0] = 0;
+
+  for(i = 0; i < FS_LOGGING_QUEUE_LENGTH_RECORDS; i++)
+  {
+    snprintf(&expected[strlen(expected)], sizeof(expected) - strlen(expected), "line%u,", i);
+  }
+
+  strcat(expected, "[log: 3 lines dropped]\r\n");
+
+  for(i = 0; ( i < 2000 ) && ( numCollected < FS_LOGGING_QUEUE_LENGTH_RECORDS + 1 ); i++)
+  {
+    usleep(1000);
+    collected[0] = 0;
+    numCollected = 0;
+    FS_LogStore_Query(0, collect, NULL);
+  }
+
+  CHECK( !strcmp(collected, expected) );
+  CHECK(0 == atomic_load(&writesFromLoggingThread));
+
+  unlink(path);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,120 @@
+/*
+FS_LogStore benchmark on a 64MB file: append rate, mount time of a full
+store, and query latency for the time index seek (with the callback stopping
+after one record) and for streaming records out. Reports only; run with
+'ctest -L bench -V'.
+*/
+#include "FS_LogStore.h"
+#include "FS_Filesystem_Stdio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STORE_SIZE_BYTES ( 64UL * 1024 * 1024 )
+#define SECTOR_SIZE_BYTES 4096
+#define RECORD_LENGTH_BYTES 64
+#define RECORD_INTERVAL_MICROSECONDS 1000
+#define NUM_QUERIES 1000
+#define RECORDS_PER_STREAMING_QUERY 1000
+
+static FS_Filesystem_t fs;
+static char path[] = "/tmp/fs_logstore_bench_XXXXXX";
+static uint32_t recordsWanted;
+
+static uint64_t nowMicroseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static _Bool takeRecords(const FS_LogStore_Record_t * record, void * context)
+{
+  return --recordsWanted > 0;
+}
+
+static _Bool mount(void)
+{
+  FS_LogStore_InitStruct_t init;
+
+  FS_LogStore_InitStructInit(&init);
+  init.fs = &fs;
+  init.path = path;
+  init.sizeBytes = STORE_SIZE_BYTES;
+  init.sectorSizeBytes = SECTOR_SIZE_BYTES;
+
+  return FS_LogStore_Init(&init);
+}
+
+int main(void)
+{
+  char record[RECORD_LENGTH_BYTES];
+  uint64_t start, elapsed, lastTimestamp;
+  uint32_t i, numRecords;
+  int fd;
+
+  fd = mkstemp(path);
+  close(fd);
+
+  FS_Filesystem_StdioInit(&fs);
+
+  if(!mount())
+  {
+    fprintf(stderr, "mount failed\n");
+    return 1;
+  }
+
+  // Enough records to wrap the store once.
+  numRecords = STORE_SIZE_BYTES / ( RECORD_LENGTH_BYTES + 16 ) * 11 / 10;
+  memset(record, 'x', sizeof(record));
+
+  start = nowMicroseconds();
+
+  for(i = 0; i < numRecords; i++)
+  {
+    if( !FS_LogStore_Append( (uint64_t)i * RECORD_INTERVAL_MICROSECONDS, record, sizeof(record) ) )
+    {
+      fprintf(stderr, "append %lu failed\n", (unsigned long)i);
+      return 1;
+    }
+  }
+
+  elapsed = nowMicroseconds() - start;
+  printf( "append:          %lu records in %.2f s, %.0f records/s\n",
+          (unsigned long)numRecords, elapsed / 1e6, numRecords * 1e6 / elapsed );
+
+  // The store is reopened by a fresh mount, as after a reset.
+  start = nowMicroseconds();
+  mount();
+  printf("mount (full):    %.2f ms\n", ( nowMicroseconds() - start ) / 1e3);
+
+  lastTimestamp = (uint64_t)( numRecords - 1 ) * RECORD_INTERVAL_MICROSECONDS;
+
+  // Seek latency: spread the start times over the whole store.
+  start = nowMicroseconds();
+
+  for(i = 0; i < NUM_QUERIES; i++)
+  {
+    recordsWanted = 1;
+    FS_LogStore_Query(lastTimestamp / NUM_QUERIES * i, takeRecords, NULL);
+  }
+
+  printf("query (seek):    %.1f us\n", (double)( nowMicroseconds() - start ) / NUM_QUERIES);
+
+  // Streaming: the cost per record once positioned.
+  start = nowMicroseconds();
+  recordsWanted = RECORDS_PER_STREAMING_QUERY;
+  FS_LogStore_Query(lastTimestamp / 2, takeRecords, NULL);
+  elapsed = nowMicroseconds() - start;
+  printf( "query (stream):  %d records in %.2f ms, %.2f us/record\n",
+          RECORDS_PER_STREAMING_QUERY, elapsed / 1e3, (double)elapsed / RECORDS_PER_STREAMING_QUERY );
+
+  unlink(path);
+
+  return 0;
+}
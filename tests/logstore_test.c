@@ -0,0 +1,258 @@
+/*
+FS_LogStore on an ordinary file, with a filesystem wrapper which can tear a
+write part way through. Covers queries, wrap around, appending from a query
+callback and recovery from a failed append, at run time and after a remount.
+*/
+#include "test_common.h"
+
+#include "FS_LogStore.c"
+
+#include "FS_Filesystem_Stdio.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static FS_Filesystem_t stdioFs;
+static FS_Filesystem_t faultyFs;
+static int writesUntilFailure = -1; // -1 never fails.
+static char path[] = "/tmp/fs_logstore_test_XXXXXX";
+
+// Tears the write: only the first half of the bytes reach the file.
+static _Bool faultyWrite(void * f, uint32_t offset, const void * buf, uint32_t numBytes)
+{
+  if( writesUntilFailure >= 0 && !writesUntilFailure-- )
+  {
+    stdioFs.write(f, offset, buf, numBytes / 2);
+    return false;
+  }
+
+  return stdioFs.write(f, offset, buf, numBytes);
+}
+
+static void mount(uint32_t sizeBytes, uint32_t sectorBytes)
+{
+  FS_LogStore_InitStruct_t init;
+
+  if(file)
+  {
+    faultyFs.close(file);
+    file = NULL;
+  }
+
+  FS_LogStore_InitStructInit(&init);
+  init.fs = &faultyFs;
+  init.path = path;
+  init.sizeBytes = sizeBytes;
+  init.sectorSizeBytes = sectorBytes;
+  CHECK( FS_LogStore_Init(&init) );
+}
+
+static void freshStore(uint32_t sizeBytes, uint32_t sectorBytes)
+{
+  if(file)
+  {
+    faultyFs.close(file);
+    file = NULL;
+  }
+
+  truncate(path, 0);
+  mount(sizeBytes, sectorBytes);
+}
+
+// Collects the queried records as "payload," strings.
+static char collected[65536];
+static uint64_t lastCollectedTimestamp;
+static _Bool collectedInOrder;
+
+static void collectReset(void)
+{
+  collected[0] = 0;
+  lastCollectedTimestamp = 0;
+  collectedInOrder = true;
+}
+
+static _Bool collect(const FS_LogStore_Record_t * record, void * context)
+{
+  size_t length = strlen(collected);
+
+  if(record->timestampMicroseconds < lastCollectedTimestamp)
+  {
+    collectedInOrder = false;
+  }
+
+  lastCollectedTimestamp = record->timestampMicroseconds;
+
+  if( length + record->numBytes + 2 < sizeof(collected) )
+  {
+    memcpy(&collected[length], record->buf, record->numBytes);
+    collected[length + record->numBytes] = ',';
+    collected[length + record->numBytes + 1] = 0;
+  }
+
+  return true;
+}
+
+static void testQuery(void)
+{
+  freshStore(4096, 512);
+
+  CHECK( 0 == FS_LogStore_Query(0, collect, NULL) );
+
+  FS_LogStore_Append(1000, "a", 1);
+  FS_LogStore_Append(2000, "b", 1);
+  FS_LogStore_Append(3000, "c", 1);
+
+  collectReset();
+  CHECK( 3 == FS_LogStore_Query(0, collect, NULL) );
+  CHECK( !strcmp(collected, "a,b,c,") );
+
+  collectReset();
+  CHECK( 2 == FS_LogStore_Query(2000, collect, NULL) );
+  CHECK( !strcmp(collected, "b,c,") );
+}
+
+static void testWrapAround(void)
+{
+  char buf[16];
+  uint32_t i, delivered;
+  int n;
+
+  // Four sectors hold far fewer than the records appended.
+  freshStore(1024, 256);
+
+  for(i = 0; i < 1000; i++)
+  {
+    n = snprintf(buf, sizeof(buf), "%lu", (unsigned long)i);
+    CHECK( FS_LogStore_Append(i * 10, buf, n) );
+  }
+
+  collectReset();
+  delivered = FS_LogStore_Query(0, collect, NULL);
+  CHECK(delivered > 0 && delivered < 1000);
+  CHECK(collectedInOrder);
+  CHECK( strlen(collected) > 4 && !strcmp(&collected[strlen(collected) - 4], "999,") );
+}
+
+static unsigned int appendsFromCallback;
+
+// Appends from within the query, enough to lap the whole store.
+static _Bool lappingCallback(const FS_LogStore_Record_t * record, void * context)
+{
+  collect(record, context);
+
+  for(; appendsFromCallback < 1000; appendsFromCallback++)
+  {
+    FS_LogStore_Append(1000000 + appendsFromCallback, "appended", 8);
+  }
+
+  return true;
+}
+
+/*
+Appends a record for every one delivered, as another task logging faster than
+the console drains would. Only gives up, as a backstop, far past the point
+where the query should have stopped.
+*/
+static _Bool keepingUpCallback(const FS_LogStore_Record_t * record, void * context)
+{
+  collect(record, context);
+  FS_LogStore_Append(1000000 + appendsFromCallback, "appended", 8);
+
+  return ( ++appendsFromCallback < 100000 );
+}
+
+static void testAppendFromCallback(void)
+{
+  uint32_t delivered;
+
+  freshStore(1024, 256);
+
+  FS_LogStore_Append(1, "first", 5);
+  FS_LogStore_Append(2, "second", 6);
+
+  // Used to deadlock: the callback ran with the store's mutex held.
+  appendsFromCallback = 0;
+  collectReset();
+  FS_LogStore_Query(0, lappingCallback, NULL);
+  CHECK(appendsFromCallback > 0);
+  CHECK(collectedInOrder);
+  CHECK( !strcmp(collected, "first,") );
+
+  // The query ends at the head as it was when it started, however fast records arrive.
+  freshStore(1024, 256);
+
+  FS_LogStore_Append(1, "first", 5);
+  FS_LogStore_Append(2, "second", 6);
+
+  appendsFromCallback = 0;
+  collectReset();
+  delivered = FS_LogStore_Query(0, keepingUpCallback, NULL);
+  CHECK(2 == delivered);
+  CHECK( !strcmp(collected, "first,second,") );
+}
+
+static void testTornAppend(void)
+{
+  freshStore(4096, 512);
+
+  CHECK( FS_LogStore_Append(1000, "before1", 7) );
+  CHECK( FS_LogStore_Append(2000, "before2", 7) );
+
+  // The record write is torn part way through.
+  writesUntilFailure = 0;
+  CHECK( !FS_LogStore_Append(3000, "torn", 4) );
+  writesUntilFailure = -1;
+
+  CHECK( FS_LogStore_Append(4000, "after1", 6) );
+  CHECK( FS_LogStore_Append(5000, "after2", 6) );
+
+  collectReset();
+  FS_LogStore_Query(0, collect, NULL);
+  CHECK( !strcmp(collected, "before1,before2,after1,after2,") );
+
+  // And the same after a reset.
+  mount(4096, 512);
+  CHECK( FS_LogStore_Append(6000, "remounted", 9) );
+
+  collectReset();
+  FS_LogStore_Query(0, collect, NULL);
+  CHECK( !strcmp(collected, "before1,before2,after1,after2,remounted,") );
+
+  // A sector header which fails to write is retried by the next append.
+  freshStore(4096, 512);
+  writesUntilFailure = 0;
+  CHECK( !FS_LogStore_Append(1000, "lost", 4) );
+  writesUntilFailure = -1;
+  CHECK( FS_LogStore_Append(2000, "kept", 4) );
+
+  mount(4096, 512);
+  collectReset();
+  FS_LogStore_Query(0, collect, NULL);
+  CHECK( !strcmp(collected, "kept,") );
+}
+
+int main(void)
+{
+  int fd;
+
+  fd = mkstemp(path);
+  close(fd);
+
+  FS_Filesystem_StdioInit(&stdioFs);
+  faultyFs = stdioFs;
+  faultyFs.write = faultyWrite;
+
+  testQuery();
+  testWrapAround();
+  testAppendFromCallback();
+  testTornAppend();
+
+  if(file)
+  {
+    faultyFs.close(file);
+  }
+
+  unlink(path);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,289 @@
+/*
+FS_Metrics cost with 500 application metrics streaming to an IO stream: bytes
+per key, delta and schema frame, as reported by fs.metrics.frameBytes, and
+sampler time per sample, as reported by fs.metrics.sampleMicroseconds (on the
+host's monotonic clock, so relative rather than target figures). Between
+samples about half of the counters and gauges change by small amounts, and
+each histogram takes a few observations. Reports only; run with
+'ctest -L bench -V'.
+*/
+#include "test_common.h"
+
+#include "FS_Metrics.c"
+
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_COUNTERS 300
+#define NUM_GAUGES 196
+#define NUM_HISTOGRAMS 4
+#define NUM_METRICS ( NUM_COUNTERS + NUM_GAUGES + NUM_HISTOGRAMS )
+#define NUM_SAMPLES ( 4 * FS_METRICS_SCHEMA_INTERVAL_FRAMES )
+#define SAMPLE_PERIOD_MICROSECONDS 1000000
+
+// Frame types per sample: a key or delta frame, preceded by a schema on some samples.
+typedef enum
+{
+  SAMPLE_DELTA,
+  SAMPLE_KEY,
+  SAMPLE_SCHEMA_AND_KEY,
+  NUM_SAMPLE_KINDS
+
+}SampleKind_t;
+
+typedef struct
+{
+  unsigned long numSamples;
+  unsigned long frameBytes;  // fs.metrics.frameBytes, i.e. the key or delta frame.
+  unsigned long schemaBytes;
+  unsigned long numTimed;
+  unsigned long sampleMicroseconds;
+
+}SampleStats_t;
+
+static FS_Metrics_t benchMetrics;
+static FS_Metrics_InitReturnsStruct_t returns;
+static volatile uint64_t tickMicroseconds;
+static atomic_uint numClockCalls;
+static SampleStats_t stats[NUM_SAMPLE_KINDS];
+static const char * kindNames[NUM_SAMPLE_KINDS] = { "delta", "key", "schema + key" };
+
+// What the sampler task wrote during the current sample.
+static uint8_t captured[65536];
+static uint32_t numCaptured;
+
+static uint32_t captureWriteBytes(const char * buf, uint32_t numBytes)
+{
+  if( numBytes <= sizeof(captured) - numCaptured )
+  {
+    memcpy(&captured[numCaptured], buf, numBytes);
+    numCaptured += numBytes;
+  }
+
+  return numBytes;
+}
+
+static uint32_t noReadBytes(char * buf, uint32_t numBytes)
+{
+  return 0;
+}
+
+static FS_DT_IOStream_t captureIO = { noReadBytes, captureWriteBytes };
+
+// Called once at the start and once at the end of every sample.
+static uint64_t monotonicMicroseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  atomic_fetch_add(&numClockCalls, 1);
+
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int32_t metricValue(int16_t handle)
+{
+  return (int32_t)atomic_load(&liveValues[metrics[handle].firstSlot]);
+}
+
+// Splits the captured bytes into frames, returning the schema bytes and the last frame's type.
+static uint8_t lastFrameType(uint32_t * schemaBytes)
+{
+  uint32_t offset, length, frameLength;
+  uint8_t shift, type;
+
+  type = 0;
+  *schemaBytes = 0;
+  offset = 0;
+
+  while( ( offset < numCaptured ) && ( FS_METRICS_FRAME_SYNC == captured[offset] ) )
+  {
+    frameLength = 1;
+    length = 0;
+
+    for(shift = 0; offset + frameLength < numCaptured; shift += 7)
+    {
+      length |= (uint32_t)( captured[offset + frameLength] & 0x7F ) << shift;
+
+      if( !( captured[offset + frameLength++] & 0x80 ) )
+      {
+        break;
+      }
+    }
+
+    type = captured[offset + frameLength];
+    frameLength += length;
+
+    if(FS_METRICS_FRAME_TYPE_SCHEMA == type)
+    {
+      *schemaBytes += frameLength;
+    }
+
+    offset += frameLength;
+  }
+
+  return type;
+}
+
+int main(void)
+{
+  FS_Metrics_InitStruct_t init;
+  static int16_t handles[NUM_METRICS];
+  static char names[NUM_METRICS][32];
+  int32_t gauges[NUM_GAUGES];
+  SampleKind_t kind, previousKind;
+  uint32_t schemaBytes;
+  int i, j, sample;
+
+  srand(1);
+
+  FS_Metrics_InitStructInit(&init);
+  FS_Metrics_InitReturnsStructInit(&returns);
+  init.instance = &benchMetrics;
+  init.timeMicroseconds = &tickMicroseconds;
+  init.getTimeMicroseconds = monotonicMicroseconds;
+  init.io = &captureIO;
+  init.samplePeriodTicks = 1;
+  FS_Metrics_Init(&init, &returns);
+
+  if(!returns.success)
+  {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+
+  for(i = 0; i < NUM_METRICS; i++)
+  {
+    if(i < NUM_COUNTERS)
+    {
+      snprintf(names[i], sizeof(names[i]), "app.counter%d.events", i);
+      handles[i] = benchMetrics.registerMetric(names[i], FS_Metrics_Counter);
+    }
+
+    else if(i < NUM_COUNTERS + NUM_GAUGES)
+    {
+      snprintf(names[i], sizeof(names[i]), "app.gauge%d.level", i);
+      handles[i] = benchMetrics.registerMetric(names[i], FS_Metrics_Gauge);
+    }
+
+    else
+    {
+      snprintf(names[i], sizeof(names[i]), "app.histogram%d.us", i);
+      handles[i] = benchMetrics.registerMetric(names[i], FS_Metrics_Histogram);
+    }
+
+    if(handles[i] < 0)
+    {
+      fprintf(stderr, "registering metric %d failed\n", i);
+      return 1;
+    }
+  }
+
+  for(i = 0; i < NUM_GAUGES; i++)
+  {
+    gauges[i] = rand() % 100000;
+  }
+
+  xTaskCreate(returns.samplerLoop, "FS_Metrics", 0, NULL, 0, NULL);
+
+  while(!samplerTask)
+  {
+    usleep(1000);
+  }
+
+  previousKind = SAMPLE_DELTA;
+
+  for(sample = 0; sample <= NUM_SAMPLES; sample++)
+  {
+    for(i = 0; i < NUM_METRICS; i++)
+    {
+      if( rand() % 2 )
+      {
+        continue;
+      }
+
+      if(i < NUM_COUNTERS)
+      {
+        benchMetrics.add(handles[i], rand() % 100);
+      }
+
+      else if(i < NUM_COUNTERS + NUM_GAUGES)
+      {
+        gauges[i - NUM_COUNTERS] += rand() % 21 - 10;
+        benchMetrics.set(handles[i], gauges[i - NUM_COUNTERS]);
+      }
+
+      else
+      {
+        for(j = 0; j < 8; j++)
+        {
+          benchMetrics.observe(handles[i], rand() % 5000);
+        }
+      }
+    }
+
+    numCaptured = 0;
+    tickMicroseconds += SAMPLE_PERIOD_MICROSECONDS;
+    returns.tick();
+
+    // The sample's frames are all written by the time it reads the clock to finish.
+    while( atomic_load(&numClockCalls) < 2 * (unsigned int)( sample + 1 ) )
+    {
+      sched_yield();
+    }
+
+    /*
+    fs.metrics.sampleMicroseconds is set just after that, so the previous
+    sample's figure is read now, once this one has started.
+    */
+    if(sample > 0)
+    {
+      stats[previousKind].numTimed++;
+      stats[previousKind].sampleMicroseconds += (unsigned long)metricValue(sampleMicrosecondsMetric);
+    }
+
+    if(sample == NUM_SAMPLES)
+    {
+      break;
+    }
+
+    if( FS_METRICS_FRAME_TYPE_DELTA == lastFrameType(&schemaBytes) )
+    {
+      kind = SAMPLE_DELTA;
+    }
+
+    else
+    {
+      kind = schemaBytes ? SAMPLE_SCHEMA_AND_KEY : SAMPLE_KEY;
+    }
+
+    stats[kind].numSamples++;
+    stats[kind].frameBytes += (unsigned long)metricValue(frameBytesMetric);
+    stats[kind].schemaBytes += schemaBytes;
+    previousKind = kind;
+  }
+
+  printf( "metrics:         %d registered (%d counters, %d gauges, %d histograms), %d samples\n",
+          NUM_METRICS, NUM_COUNTERS, NUM_GAUGES, NUM_HISTOGRAMS, NUM_SAMPLES );
+
+  for(kind = 0; kind < NUM_SAMPLE_KINDS; kind++)
+  {
+    if( !stats[kind].numSamples || !stats[kind].numTimed )
+    {
+      continue;
+    }
+
+    printf( "%-15s %4lu samples, frameBytes %6.0f (%.2f bytes/metric), schema %6.0f bytes, "
+            "sampleMicroseconds %7.1f\n",
+            kindNames[kind],
+            stats[kind].numSamples,
+            (double)stats[kind].frameBytes / stats[kind].numSamples,
+            (double)stats[kind].frameBytes / stats[kind].numSamples / NUM_METRICS,
+            (double)stats[kind].schemaBytes / stats[kind].numSamples,
+            (double)stats[kind].sampleMicroseconds / stats[kind].numTimed );
+  }
+
+  return 0;
+}
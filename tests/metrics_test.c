@@ -0,0 +1,276 @@
+/*
+FS_Metrics file sink and the host decoder. The sink must stay within its ring,
+resume where the last boot stopped and time sampling with the fine clock; the
+decoder must unroll the ring, and drop deltas after a gap and frames with
+trailing bytes.
+*/
+#include "test_common.h"
+
+#include "FS_Metrics.c"
+
+#include "FS_Filesystem_Stdio.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define RING_SIZE_BYTES 512
+#define NUM_SAMPLES     100
+
+// Each call to the fine clock moves it on by this much, so a sample takes exactly this long.
+#define FINE_CLOCK_STEP_MICROSECONDS 7
+
+static FS_Filesystem_t stdioFs;
+static FS_Filesystem_t countingFs;
+static atomic_int numSyncs;
+static volatile uint64_t tickMicroseconds;
+static uint64_t fineMicroseconds;
+static FS_Metrics_t testMetrics;
+static FS_Metrics_InitReturnsStruct_t returns;
+static char path[] = "/tmp/fs_metrics_test_XXXXXX";
+
+// The sampler syncs once per sample, after writing the header.
+static _Bool countingSync(void * f)
+{
+  _Bool ok = stdioFs.sync(f);
+
+  atomic_fetch_add(&numSyncs, 1);
+
+  return ok;
+}
+
+static uint64_t fineClock(void)
+{
+  fineMicroseconds += FINE_CLOCK_STEP_MICROSECONDS;
+  return fineMicroseconds;
+}
+
+static void init(void)
+{
+  FS_Metrics_InitStruct_t initStruct;
+
+  // Start the registry over, as a reboot would.
+  if(file)
+  {
+    countingFs.close(file);
+    file = NULL;
+  }
+
+  if(registryMutex)
+  {
+    vSemaphoreDelete(registryMutex);
+  }
+
+  atomic_store(&numMetrics, 0);
+  numSlotsAllocated = 0;
+  numHistograms = 0;
+
+  FS_Metrics_InitStructInit(&initStruct);
+  FS_Metrics_InitReturnsStructInit(&returns);
+  initStruct.instance = &testMetrics;
+  initStruct.timeMicroseconds = &tickMicroseconds;
+  initStruct.getTimeMicroseconds = fineClock;
+  initStruct.fs = &countingFs;
+  initStruct.path = path;
+  initStruct.fileSizeBytes = RING_SIZE_BYTES;
+  initStruct.samplePeriodTicks = 1;
+  FS_Metrics_Init(&initStruct, &returns);
+  CHECK(returns.success);
+  CHECK(returns.samplerLoop);
+}
+
+static void sample(void)
+{
+  int before = atomic_load(&numSyncs);
+
+  tickMicroseconds += 1000;
+  returns.tick();
+
+  while(atomic_load(&numSyncs) == before)
+  {
+    usleep(100);
+  }
+
+  // Let set() of the sample time land before the next sample is asked for.
+  usleep(1000);
+}
+
+static uint32_t storedOffset(void)
+{
+  uint8_t header[FS_METRICS_FILE_HEADER_BYTES];
+
+  CHECK( stdioFs.read(file, 0, header, sizeof(header)) );
+  CHECK( !memcmp(header, FS_METRICS_FILE_MAGIC, 4) );
+
+  return (uint32_t)header[4] | ( (uint32_t)header[5] << 8 ) |
+         ( (uint32_t)header[6] << 16 ) | ( (uint32_t)header[7] << 24 );
+}
+
+static void writeHeader(const char * magic, uint32_t offset)
+{
+  uint8_t header[FS_METRICS_FILE_HEADER_BYTES];
+
+  memcpy(header, magic, 4);
+  header[4] = (uint8_t)offset;
+  header[5] = (uint8_t)( offset >> 8 );
+  header[6] = (uint8_t)( offset >> 16 );
+  header[7] = (uint8_t)( offset >> 24 );
+  CHECK( stdioFs.write(file, 0, header, sizeof(header)) );
+  CHECK( stdioFs.sync(file) );
+}
+
+// Runs the decoder over a file, leaving its CSV output in testOutput.
+static void decode(const char * decodePath)
+{
+  char command[512];
+  char buf[4096];
+  size_t n;
+  FILE * pipe;
+
+  testOutputClear();
+  snprintf(command, sizeof(command), "%s %s 2>/dev/null", FS_METRICS_DECODE, decodePath);
+  pipe = popen(command, "r");
+  CHECK(pipe);
+
+  while( pipe && ( n = fread(buf, 1, sizeof(buf), pipe) ) > 0 )
+  {
+    testOutputWriteBytes(buf, (uint32_t)n);
+  }
+
+  CHECK( pipe && ( 0 == pclose(pipe) ) );
+}
+
+static size_t frame(uint8_t * out, const uint8_t * payload, uint8_t length)
+{
+  out[0] = FS_METRICS_FRAME_SYNC;
+  out[1] = length;
+  memcpy(&out[2], payload, length);
+
+  return 2 + length;
+}
+
+static void testDecoderFraming(void)
+{
+  char framesPath[] = "/tmp/fs_metrics_frames_XXXXXX";
+  uint8_t stream[256];
+  size_t length = 0;
+  FILE * f;
+  int fd;
+
+  // One gauge "g". Values are zigzag encoded: 2n for n >= 0. Every field fits one varint byte.
+  static const uint8_t schema[]     = { 'S', 1, FS_Metrics_Gauge, 1, 'g' };
+  static const uint8_t key0[]       = { 'K', 0, 100, 10 };      // g = 5
+  static const uint8_t delta1[]     = { 'D', 1, 10, 2 };        // g = 6
+  static const uint8_t delta3[]     = { 'D', 3, 10, 2 };        // seq 2 lost: dropped
+  static const uint8_t delta4[]     = { 'D', 4, 10, 2 };        // still no key: dropped
+  static const uint8_t key5[]       = { 'K', 5, 50, 20 };      // g = 10
+  static const uint8_t key6Long[]   = { 'K', 6, 60, 22, 0 };   // trailing byte: rejected
+  static const uint8_t delta7[]     = { 'D', 7, 10, 2 };        // follows a rejected frame: dropped
+  static const uint8_t key8[]       = { 'K', 8, 70, 40 };      // g = 20
+  static const uint8_t schemaLong[] = { 'S', 1, FS_Metrics_Gauge, 1, 'h', 0 };
+  static const uint8_t key9[]       = { 'K', 9, 80, 60 };      // still "g" = 30
+
+  length += frame(&stream[length], schema, sizeof(schema));
+  length += frame(&stream[length], key0, sizeof(key0));
+  length += frame(&stream[length], delta1, sizeof(delta1));
+  length += frame(&stream[length], delta3, sizeof(delta3));
+  length += frame(&stream[length], delta4, sizeof(delta4));
+  length += frame(&stream[length], key5, sizeof(key5));
+  length += frame(&stream[length], key6Long, sizeof(key6Long));
+  length += frame(&stream[length], delta7, sizeof(delta7));
+  length += frame(&stream[length], key8, sizeof(key8));
+  length += frame(&stream[length], schemaLong, sizeof(schemaLong));
+  length += frame(&stream[length], schema, sizeof(schema));
+  length += frame(&stream[length], key9, sizeof(key9));
+
+  fd = mkstemp(framesPath);
+  f = fdopen(fd, "wb");
+  CHECK( length == fwrite(stream, 1, length, f) );
+  fclose(f);
+
+  decode(framesPath);
+  CHECK( testOutputContains("\n0,100,g,5\n") );
+  CHECK( testOutputContains("\n1,110,g,6\n") );
+  CHECK( !testOutputContains("\n3,") );
+  CHECK( !testOutputContains("\n4,") );
+  CHECK( testOutputContains("\n5,50,g,10\n") );
+  CHECK( !testOutputContains("\n6,") );
+  CHECK( !testOutputContains("\n7,") );
+  CHECK( testOutputContains("\n8,70,g,20\n") );
+  CHECK( !testOutputContains(",h,") );
+  CHECK( testOutputContains("\n9,80,g,30\n") );
+
+  unlink(framesPath);
+}
+
+int main(void)
+{
+  struct stat st;
+  uint32_t offset;
+  char lastSeq[32];
+  int fd, i;
+
+  fd = mkstemp(path);
+  close(fd);
+
+  FS_Filesystem_StdioInit(&stdioFs);
+  countingFs = stdioFs;
+  countingFs.sync = countingSync;
+
+  init();
+  CHECK(FS_METRICS_FILE_HEADER_BYTES == fileOffset);
+
+  xTaskCreate(returns.samplerLoop, "FS_Metrics", 0, NULL, 0, NULL);
+
+  while(!samplerTask)
+  {
+    usleep(1000);
+  }
+
+  // Many times the ring's worth of frames: the file must wrap rather than grow.
+  for(i = 0; i < NUM_SAMPLES; i++)
+  {
+    sample();
+    CHECK( storedOffset() == fileOffset );
+  }
+
+  CHECK( 0 == stat(path, &st) );
+  CHECK(RING_SIZE_BYTES == st.st_size);
+
+  // Timed on the fine clock, not the tick clock (which does not move during a sample).
+  CHECK( FINE_CLOCK_STEP_MICROSECONDS ==
+         atomic_load(&liveValues[metrics[sampleMicrosecondsMetric].firstSlot]) );
+
+  // The unrolled ring decodes up to the newest frame, which carries that sample time.
+  decode(path);
+  snprintf(lastSeq, sizeof(lastSeq), "\n%lu,", (unsigned long)( frameSeq - 1 ));
+  CHECK( testOutputContains(lastSeq) );
+  CHECK( testOutputContains(",fs.metrics.sampleMicroseconds,7\n") );
+  CHECK( !testOutputContains("\n0,") );
+
+  // A reboot carries on from the stored offset, rather than overwriting from the start.
+  offset = fileOffset;
+  init();
+  CHECK(offset == fileOffset);
+
+  sample();
+  CHECK( 0 == stat(path, &st) );
+  CHECK(RING_SIZE_BYTES == st.st_size);
+
+  // A damaged or out of range header starts the ring over.
+  writeHeader("XXXX", offset);
+  init();
+  CHECK(FS_METRICS_FILE_HEADER_BYTES == fileOffset);
+
+  writeHeader(FS_METRICS_FILE_MAGIC, RING_SIZE_BYTES);
+  init();
+  CHECK(FS_METRICS_FILE_HEADER_BYTES == fileOffset);
+
+  testDecoderFraming();
+
+  countingFs.close(file);
+  file = NULL;
+  unlink(path);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,26 @@
+// Test console configuration. Each size may be overridden per test target.
+#ifndef FS_TEST_FS_CONSOLE_CONF_H
+#define FS_TEST_FS_CONSOLE_CONF_H
+
+#ifndef FS_CONSOLE_MAX_NUM_COMMANDS
+#define FS_CONSOLE_MAX_NUM_COMMANDS 16
+#endif
+
+#ifndef FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES
+#define FS_CONSOLE_INPUT_BUFFER_LENGTH_BYTES 64
+#endif
+
+#ifndef FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES
+#define FS_CONSOLE_OUTPUT_BUFFER_LENGTH_BYTES 128
+#endif
+
+#ifndef FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS
+#define FS_CONSOLE_MAX_NUM_STORED_IO_STREAMS 4
+#endif
+
+#define FS_CONSOLE_LINE_ENDING '\r'
+#define FS_CONSOLE_PROMPT_CHARACTER ">"
+#define FS_CONSOLE_SPLASH_SCREEN "FS_System test console\r\n"
+#define FS_CONSOLE_IOSTREAM_MUTEX_TIMEOUT_TICKS 10
+
+#endif // FS_TEST_FS_CONSOLE_CONF_H
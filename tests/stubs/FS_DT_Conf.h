@@ -0,0 +1,15 @@
+// Host stand-in for the FirmwareSavvy data types configuration header.
+#ifndef FS_TEST_FS_DT_CONF_H
+#define FS_TEST_FS_DT_CONF_H
+
+#include <stdint.h>
+
+typedef struct
+{
+  // Both return the number of bytes transferred.
+  uint32_t(*readBytes)(char * buf, uint32_t numBytes);
+  uint32_t(*writeBytes)(const char * buf, uint32_t numBytes);
+
+}FS_DT_IOStream_t;
+
+#endif // FS_TEST_FS_DT_CONF_H
@@ -0,0 +1,7 @@
+// Host stand-in; the USART is just an FS_DT_IOStream_t under test.
+#ifndef FS_TEST_FS_DT_USART_H
+#define FS_TEST_FS_DT_USART_H
+
+#include "FS_DT_Conf.h"
+
+#endif // FS_TEST_FS_DT_USART_H
@@ -0,0 +1,7 @@
+#ifndef FS_TEST_FS_TASKPRIORITIES_CONF_H
+#define FS_TEST_FS_TASKPRIORITIES_CONF_H
+
+#define FS_CONSOLE_STACK_DEPTH 512
+#define FS_CONSOLE_TASK_PRIORITY 1
+
+#endif // FS_TEST_FS_TASKPRIORITIES_CONF_H
@@ -0,0 +1,43 @@
+/*
+Host stand-in for the FreeRTOS headers, just enough to build and run the
+FS_System modules on a POSIX host for testing. Tasks are pthreads, mutexes
+are pthread mutexes and task notifications are a counter and condition
+variable. See freertos_host.c.
+*/
+#ifndef FS_TEST_FREERTOS_H
+#define FS_TEST_FREERTOS_H
+
+#include <stdint.h>
+#include <assert.h>
+
+typedef void * SemaphoreHandle_t;
+typedef void * TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+#define portMAX_DELAY       0xFFFFFFFFUL
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ( (TickType_t)(ms) )
+
+#ifndef configMAX_PRIORITIES
+#define configMAX_PRIORITIES 8
+#endif
+
+#define configASSERT(x) assert(x)
+
+// There are no interrupts on the host; per-core exclusion comes from pinning.
+#define portSET_INTERRUPT_MASK_FROM_ISR() 0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x) ( (void)(x) )
+#define portYIELD_FROM_ISR(x) ( (void)(x) )
+
+// The CPU the calling thread is running on; tests pin one producer per CPU.
+int hostGetCoreID(void);
+#define portGET_CORE_ID() hostGetCoreID()
+
+#endif // FS_TEST_FREERTOS_H
@@ -0,0 +1,209 @@
+/*
+pthread implementation of the FreeRTOS calls used by FS_System. Only the
+semantics the modules rely on are provided.
+*/
+#define _GNU_SOURCE
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint32_t notifyCount;
+  void(*taskFunction)(void * params);
+  void * params;
+
+}HostTask_t;
+
+static __thread HostTask_t * currentTask;
+
+// Handle for threads not started through xTaskCreate() (e.g. main).
+static __thread HostTask_t adoptedTask;
+
+static HostTask_t * newTask(void)
+{
+  HostTask_t * task;
+
+  task = calloc(1, sizeof(HostTask_t));
+  pthread_mutex_init(&task->mutex, NULL);
+  pthread_cond_init(&task->cond, NULL);
+
+  return task;
+}
+
+static void * trampoline(void * arg)
+{
+  currentTask = arg;
+  currentTask->taskFunction(currentTask->params);
+
+  return NULL;
+}
+
+int hostGetCoreID(void)
+{
+  return sched_getcpu();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  pthread_mutex_t * mutex;
+
+  mutex = malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(mutex, NULL);
+
+  return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+  (void)ticksToWait;
+  pthread_mutex_lock(semaphore);
+
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  pthread_mutex_unlock(semaphore);
+
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+  pthread_mutex_destroy(semaphore);
+  free(semaphore);
+}
+
+BaseType_t xTaskCreate( void(*taskFunction)(void * params),
+                        const char * name,
+                        uint32_t stackDepth,
+                        void * params,
+                        UBaseType_t priority,
+                        TaskHandle_t * createdTask )
+{
+  HostTask_t * task;
+
+  (void)name;
+  (void)stackDepth;
+  (void)priority;
+
+  task = newTask();
+  task->taskFunction = taskFunction;
+  task->params = params;
+
+  if( pthread_create(&task->thread, NULL, trampoline, task) )
+  {
+    return pdFAIL;
+  }
+
+  pthread_detach(task->thread);
+
+  if(createdTask)
+  {
+    *createdTask = task;
+  }
+
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  if(!currentTask)
+  {
+    currentTask = &adoptedTask;
+    pthread_mutex_init(&currentTask->mutex, NULL);
+    pthread_cond_init(&currentTask->cond, NULL);
+    currentTask->thread = pthread_self();
+  }
+
+  return currentTask;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (TickType_t)( now.tv_sec * 1000 + now.tv_nsec / 1000000 );
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  (void)ticks;
+  sched_yield();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+  HostTask_t * task;
+  struct timespec deadline;
+  uint32_t count;
+  int err;
+
+  task = xTaskGetCurrentTaskHandle();
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ticksToWait / 1000;
+  deadline.tv_nsec += ( ticksToWait % 1000 ) * 1000000L;
+
+  if(deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&task->mutex);
+
+  err = 0;
+
+  while( !task->notifyCount && ( ETIMEDOUT != err ) )
+  {
+    if(portMAX_DELAY == ticksToWait)
+    {
+      pthread_cond_wait(&task->cond, &task->mutex);
+    }
+
+    else
+    {
+      err = pthread_cond_timedwait(&task->cond, &task->mutex, &deadline);
+    }
+  }
+
+  count = task->notifyCount;
+
+  if(count)
+  {
+    task->notifyCount = clearCountOnExit ? 0 : ( count - 1 );
+  }
+
+  pthread_mutex_unlock(&task->mutex);
+
+  return count;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * higherPriorityTaskWoken)
+{
+  HostTask_t * hostTask = task;
+
+  pthread_mutex_lock(&hostTask->mutex);
+  hostTask->notifyCount++;
+  pthread_cond_signal(&hostTask->cond);
+  pthread_mutex_unlock(&hostTask->mutex);
+
+  if(higherPriorityTaskWoken)
+  {
+    *higherPriorityTaskWoken = pdFALSE;
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef FS_TEST_TASK_H
+#define FS_TEST_TASK_H
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreate( void(*taskFunction)(void * params),
+                        const char * name,
+                        uint32_t stackDepth,
+                        void * params,
+                        UBaseType_t priority,
+                        TaskHandle_t * createdTask );
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+
+// Yields rather than sleeping, so polling loops stay fast under test.
+void vTaskDelay(TickType_t ticks);
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * higherPriorityTaskWoken);
+
+#endif // FS_TEST_TASK_H
@@ -0,0 +1,260 @@
+/*
+FS_Supervisor with simulated time. The test thread plays the timer ISR,
+calling tick(), while the supervisor task runs as a thread. A hung task must
+be warned about and then reported as fatal - from the supervisor task, never
+from tick() - and stay latched; a task which keeps kicking never is. Tasks
+registering at the same time must each get their own slot.
+*/
+#include "test_common.h"
+
+#include "FS_Supervisor.c"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define DEADLINE_MICROSECONDS 1000
+#define STEP_MICROSECONDS 100
+
+static volatile uint64_t simulatedMicroseconds;
+static FS_Supervisor_t supervisor;
+static FS_Supervisor_InitReturnsStruct_t returns;
+static TaskHandle_t isrContext;
+
+static atomic_uint numWarnings;
+static atomic_uint numFatals;
+static atomic_bool raisedFromIsrContext;
+static char lastFatalMessage[128];
+
+static int16_t excRegisterModule(const char * description, void(*fatalHandlerCallback)(void))
+{
+  return 7;
+}
+
+static void excRaiseWarning(int16_t moduleLabel, const char * fmt, ...)
+{
+  if(xTaskGetCurrentTaskHandle() == isrContext)
+  {
+    atomic_store(&raisedFromIsrContext, true);
+  }
+
+  atomic_fetch_add(&numWarnings, 1);
+}
+
+static void excRaiseFatal(int16_t moduleLabel, const char * fmt, ...)
+{
+  va_list args;
+
+  if(xTaskGetCurrentTaskHandle() == isrContext)
+  {
+    atomic_store(&raisedFromIsrContext, true);
+  }
+
+  va_start(args, fmt);
+  vsnprintf(lastFatalMessage, sizeof(lastFatalMessage), fmt, args);
+  va_end(args);
+
+  atomic_fetch_add(&numFatals, 1);
+}
+
+static FS_Exception_t testExc = { excRegisterModule, excRaiseFatal, excRaiseWarning };
+
+// Advances time in steps, ticking as the timer would and kicking 'kicked' (if any) every step.
+static void run(uint32_t microseconds, int16_t kicked)
+{
+  uint32_t elapsed;
+
+  for(elapsed = 0; elapsed < microseconds; elapsed += STEP_MICROSECONDS)
+  {
+    simulatedMicroseconds += STEP_MICROSECONDS;
+
+    if(kicked >= 0)
+    {
+      supervisor.kick(kicked);
+    }
+
+    returns.tick();
+  }
+}
+
+// The supervisor task reports asynchronously; give it a moment.
+static void waitFor(atomic_uint * counter, unsigned int value)
+{
+  int i;
+
+  for(i = 0; ( i < 2000 ) && ( atomic_load(counter) < value ); i++)
+  {
+    usleep(1000);
+  }
+}
+
+#define NUM_REGISTERING_THREADS ( FS_SUPERVISOR_MAX_NUM_TASKS + 2 )
+#define REGISTRATION_ROUNDS 200
+
+static const char * registeringNames[NUM_REGISTERING_THREADS];
+static int16_t registeredHandles[NUM_REGISTERING_THREADS];
+static pthread_barrier_t registerBarrier;
+
+static void * registeringThread(void * arg)
+{
+  intptr_t i = (intptr_t)arg;
+
+  pthread_barrier_wait(&registerBarrier);
+  registeredHandles[i] = supervisor.registerTask(registeringNames[i], DEADLINE_MICROSECONDS);
+
+  return NULL;
+}
+
+/*
+Registers from many threads at once; the free slots must go to distinct tasks.
+The window is only a few instructions wide, so it is tried over many rounds.
+*/
+static void testConcurrentRegistration(void)
+{
+  static char names[NUM_REGISTERING_THREADS][16];
+  pthread_t threads[NUM_REGISTERING_THREADS];
+  int16_t numAlreadyRegistered;
+  int i, j, round, numRegistered;
+
+  numAlreadyRegistered = atomic_load(&numTasks);
+
+  for(i = 0; i < NUM_REGISTERING_THREADS; i++)
+  {
+    snprintf(names[i], sizeof(names[i]), "concurrent%d", i);
+    registeringNames[i] = names[i];
+  }
+
+  for(round = 0; round < REGISTRATION_ROUNDS; round++)
+  {
+    atomic_store(&numTasks, numAlreadyRegistered);
+    pthread_barrier_init(&registerBarrier, NULL, NUM_REGISTERING_THREADS);
+
+    for(i = 0; i < NUM_REGISTERING_THREADS; i++)
+    {
+      pthread_create( &threads[i], NULL, registeringThread, (void *)(intptr_t)i );
+    }
+
+    for(i = 0; i < NUM_REGISTERING_THREADS; i++)
+    {
+      pthread_join(threads[i], NULL);
+    }
+
+    pthread_barrier_destroy(&registerBarrier);
+
+    numRegistered = 0;
+
+    for(i = 0; i < NUM_REGISTERING_THREADS; i++)
+    {
+      if(registeredHandles[i] < 0)
+      {
+        continue;
+      }
+
+      numRegistered++;
+      CHECK(tasks[registeredHandles[i]].name == registeringNames[i]);
+
+      for(j = 0; j < i; j++)
+      {
+        CHECK(registeredHandles[j] != registeredHandles[i]);
+      }
+    }
+
+    CHECK(FS_SUPERVISOR_MAX_NUM_TASKS - numAlreadyRegistered == numRegistered);
+    CHECK(FS_SUPERVISOR_MAX_NUM_TASKS == atomic_load(&numTasks));
+  }
+}
+
+static char report[4096];
+
+static int reportPrintf(const char * fmt, ...)
+{
+  va_list args;
+  size_t length;
+  int n;
+
+  length = strlen(report);
+  va_start(args, fmt);
+  n = vsnprintf(&report[length], sizeof(report) - length, fmt, args);
+  va_end(args);
+
+  return n;
+}
+
+int main(void)
+{
+  FS_Supervisor_InitStruct_t init;
+  FS_Supervisor_StallRecord_t stall;
+  int16_t healthy, hung, slow;
+
+  isrContext = xTaskGetCurrentTaskHandle();
+
+  FS_Supervisor_InitStructInit(&init);
+  FS_Supervisor_InitReturnsStructInit(&returns);
+  init.instance = &supervisor;
+  init.exc = &testExc;
+  init.timeMicroseconds = &simulatedMicroseconds;
+  FS_Supervisor_Init(&init, &returns);
+  CHECK(returns.success);
+
+  xTaskCreate(returns.mainLoop, "FS_Supervisor", 0, NULL, 0, NULL);
+
+  // Let the supervisor task record its handle before anything is flagged.
+  while(!supervisorTask)
+  {
+    usleep(1000);
+  }
+
+  healthy = supervisor.registerTask("healthy", DEADLINE_MICROSECONDS);
+  hung = supervisor.registerTask("hung", DEADLINE_MICROSECONDS);
+  CHECK(healthy >= 0 && hung >= 0);
+
+  // Within the deadline nothing is flagged; a warning follows once overdue.
+  supervisor.kick(hung);
+  run(DEADLINE_MICROSECONDS, healthy);
+  CHECK(0 == atomic_load(&numWarnings));
+
+  run(2 * STEP_MICROSECONDS, healthy);
+  waitFor(&numWarnings, 1);
+  CHECK(1 == atomic_load(&numWarnings));
+  CHECK(0 == atomic_load(&numFatals));
+
+  // Past the fatal multiple of the deadline the stall is reported once.
+  run(FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER * DEADLINE_MICROSECONDS, healthy);
+  waitFor(&numFatals, 1);
+  run(10 * DEADLINE_MICROSECONDS, healthy);
+  usleep(10000);
+  CHECK(1 == atomic_load(&numWarnings));
+  CHECK(1 == atomic_load(&numFatals));
+  CHECK( !strncmp(lastFatalMessage, "Task 'hung' stalled", 19) );
+  CHECK( !atomic_load(&raisedFromIsrContext) );
+
+  CHECK( FS_Supervisor_GetLastFatalStall(&stall) );
+  CHECK( !strcmp(stall.name, "hung") );
+  CHECK(stall.overdueMicroseconds > FS_SUPERVISOR_FATAL_DEADLINE_MULTIPLIER * DEADLINE_MICROSECONDS);
+
+  // The stall stays latched even if the task comes back.
+  supervisor.kick(hung);
+  CHECK(TASK_STATE_FATAL == atomic_load(&tasks[hung].state));
+  CHECK(TASK_STATE_OK == atomic_load(&tasks[healthy].state));
+
+  report[0] = 0;
+  FS_Supervisor_PrintReport(reportPrintf);
+  CHECK( strstr(report, "hung: STALLED") && strstr(report, "healthy: ok") );
+
+  // A warning is cleared by a kick, and a later overrun is warned about again.
+  slow = supervisor.registerTask("slow", DEADLINE_MICROSECONDS);
+  run(2 * DEADLINE_MICROSECONDS, healthy);
+  waitFor(&numWarnings, 2);
+  CHECK(2 == atomic_load(&numWarnings));
+  supervisor.kick(slow);
+  CHECK(TASK_STATE_OK == atomic_load(&tasks[slow].state));
+  run(2 * DEADLINE_MICROSECONDS, healthy);
+  waitFor(&numWarnings, 3);
+  CHECK(3 == atomic_load(&numWarnings));
+  CHECK(1 == atomic_load(&numFatals));
+
+  testConcurrentRegistration();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,151 @@
+/*
+Helpers shared by the host tests: a minimal check macro, in-memory
+FS_DT_IOStream_t implementations and console set up.
+*/
+#ifndef FS_TEST_COMMON_H
+#define FS_TEST_COMMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FS_DT_Conf.h"
+#include "FS_Console.h"
+
+static int testFailures __attribute__((unused));
+
+#define CHECK(cond) \
+  do \
+  { \
+    if(!(cond)) \
+    { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  }while(0)
+
+#define TEST_RESULT() ( testFailures ? 1 : 0 )
+
+/*
+Scripted input stream. Bytes are handed out one per readBytes() call; once the
+script runs out readBytes() returns 0 (or the fallback byte, if set, so that
+commands which wait for input always terminate).
+*/
+typedef struct
+{
+  const char * data;
+  size_t length;
+  size_t pos;
+  int fallback; // -1 for none.
+
+}TestInput_t;
+
+static TestInput_t testInput = { NULL, 0, 0, -1 };
+
+static inline void testInputSet(const char * data, size_t length)
+{
+  testInput.data = data;
+  testInput.length = length;
+  testInput.pos = 0;
+}
+
+static inline uint32_t testInputReadBytes(char * buf, uint32_t numBytes)
+{
+  if(!numBytes)
+  {
+    return 0;
+  }
+
+  if(testInput.pos < testInput.length)
+  {
+    buf[0] = testInput.data[testInput.pos++];
+    return 1;
+  }
+
+  if(testInput.fallback >= 0)
+  {
+    buf[0] = (char)testInput.fallback;
+    return 1;
+  }
+
+  return 0;
+}
+
+// Captured output. Overflow is counted rather than stored.
+#define TEST_OUTPUT_CAPACITY 65536
+
+typedef struct
+{
+  char buffer[TEST_OUTPUT_CAPACITY];
+  size_t length;
+  size_t overflow;
+
+}TestOutput_t;
+
+static TestOutput_t testOutput;
+
+static inline void testOutputClear(void)
+{
+  testOutput.length = 0;
+  testOutput.overflow = 0;
+}
+
+static inline uint32_t testOutputWriteBytes(const char * buf, uint32_t numBytes)
+{
+  uint32_t room;
+
+  room = TEST_OUTPUT_CAPACITY - testOutput.length;
+
+  if(numBytes > room)
+  {
+    testOutput.overflow += numBytes - room;
+    numBytes = room;
+  }
+
+  memcpy(&testOutput.buffer[testOutput.length], buf, numBytes);
+  testOutput.length += numBytes;
+
+  return numBytes;
+}
+
+static inline _Bool testOutputContains(const char * s)
+{
+  size_t n, i;
+
+  n = strlen(s);
+
+  for(i = 0; i + n <= testOutput.length; i++)
+  {
+    if( !memcmp(&testOutput.buffer[i], s, n) )
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static FS_DT_IOStream_t testIO __attribute__((unused)) = { testInputReadBytes, testOutputWriteBytes };
+
+/*
+Initialises the console with default options, bound to instance, on io. Tests
+which need echo set it directly, as they include fs_console.c.
+*/
+static inline _Bool testConsoleInit( FS_Console_t * instance,
+                                     FS_DT_IOStream_t * io,
+                                     FS_Supervisor_t * supervisor,
+                                     FS_Console_InitReturnsStruct_t * returns )
+{
+  FS_Console_InitStruct_t init;
+
+  FS_Console_InitStructInit(&init);
+  FS_Console_InitReturnsStructInit(returns);
+  init.instance = instance;
+  init.io = io;
+  init.supervisor = supervisor;
+  FS_Console_Init(&init, returns);
+
+  return returns->success;
+}
+
+#endif // FS_TEST_COMMON_H
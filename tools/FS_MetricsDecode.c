@@ -0,0 +1,364 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_MetricsDecode.c
+ *
+ * @brief Host side decoder for the FS_Metrics telemetry stream. Reads frames
+ *        from a file (or stdin) and prints one CSV line per value:
+ *
+ *          seq,timestamp_us,name,value
+ *
+ *        Histogram buckets are printed as name[bucket]. A ring file written
+ *        by the file sink is unrolled oldest first. Build with any C99 host
+ *        compiler, e.g. cc -o fs_metrics_decode FS_MetricsDecode.c
+ *
+ *        The wire format is described in inc/FS_Metrics.h; the constants
+ *        below must match it.
+ *
+ *******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define FRAME_SYNC           0xA5
+#define FRAME_TYPE_SCHEMA    'S'
+#define FRAME_TYPE_KEY       'K'
+#define FRAME_TYPE_DELTA     'D'
+#define METRIC_TYPE_HISTOGRAM 2
+#define FILE_MAGIC           "FSMT"
+#define FILE_HEADER_BYTES    8
+
+typedef struct
+{
+  char * name;
+  uint8_t type;
+  uint32_t numSlots;
+
+}Metric_t;
+
+static Metric_t * metrics;
+static uint32_t numMetrics;
+static uint32_t * values;
+static uint32_t * decoded; // A frame's values, until the whole frame has checked out.
+static uint32_t numSlots;
+static bool haveKey;
+static uint32_t lastSeq;
+static uint64_t timestamp;
+
+static bool readVarint(const uint8_t ** p, const uint8_t * end, uint64_t * value)
+{
+  uint8_t shift;
+
+  *value = 0;
+
+  for(shift = 0; ( *p < end ) && ( shift < 64 ); shift += 7)
+  {
+    *value |= (uint64_t)( **p & 0x7F ) << shift;
+
+    if( !( *(*p)++ & 0x80 ) )
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void freeSchema(void)
+{
+  uint32_t i;
+
+  for(i = 0; i < numMetrics; i++)
+  {
+    free(metrics[i].name);
+  }
+
+  free(metrics);
+  free(values);
+  free(decoded);
+  metrics = NULL;
+  values = NULL;
+  decoded = NULL;
+  numMetrics = 0;
+  numSlots = 0;
+}
+
+static bool parseSchema(const uint8_t * p, const uint8_t * end)
+{
+  uint64_t count, length, buckets;
+  uint32_t i;
+
+  freeSchema();
+  haveKey = false;
+
+  if( !readVarint(&p, end, &count) || ( count > 65535 ) )
+  {
+    return false;
+  }
+
+  metrics = calloc(count ? count : 1, sizeof(Metric_t));
+
+  for(i = 0; i < count; i++)
+  {
+    if(p >= end)
+    {
+      return false;
+    }
+
+    metrics[i].type = *p++;
+
+    if( !readVarint(&p, end, &length) || ( length > (uint64_t)( end - p ) ) )
+    {
+      return false;
+    }
+
+    metrics[i].name = malloc(length + 1);
+    memcpy(metrics[i].name, p, length);
+    metrics[i].name[length] = 0;
+    p += length;
+    numMetrics = i + 1;
+
+    metrics[i].numSlots = 1;
+
+    if(METRIC_TYPE_HISTOGRAM == metrics[i].type)
+    {
+      if( !readVarint(&p, end, &buckets) || ( buckets > 64 ) )
+      {
+        return false;
+      }
+
+      metrics[i].numSlots = (uint32_t)buckets;
+    }
+
+    numSlots += metrics[i].numSlots;
+  }
+
+  values = calloc(numSlots ? numSlots : 1, sizeof(uint32_t));
+  decoded = calloc(numSlots ? numSlots : 1, sizeof(uint32_t));
+
+  // Trailing bytes mean this was not really a schema.
+  return ( p == end );
+}
+
+static bool decodeSchema(const uint8_t * p, const uint8_t * end)
+{
+  // Never leave a half parsed schema behind for the value frames to use.
+  if( !parseSchema(p, end) )
+  {
+    freeSchema();
+    return false;
+  }
+
+  return true;
+}
+
+static bool decodeValues(uint8_t frameType, const uint8_t * p, const uint8_t * end)
+{
+  uint64_t seq, time, zigzag;
+  uint32_t i, j, slot;
+  int32_t value;
+
+  // Deltas are meaningless until a key frame has been seen.
+  if( !metrics || ( ( FRAME_TYPE_DELTA == frameType ) && !haveKey ) )
+  {
+    return true;
+  }
+
+  if( !readVarint(&p, end, &seq) || !readVarint(&p, end, &time) )
+  {
+    return false;
+  }
+
+  // A delta only applies on top of the frame just before it; after a gap, wait for a key.
+  if( ( FRAME_TYPE_DELTA == frameType ) && ( (uint32_t)seq != (uint32_t)( lastSeq + 1 ) ) )
+  {
+    haveKey = false;
+    return true;
+  }
+
+  for(slot = 0; slot < numSlots; slot++)
+  {
+    if( !readVarint(&p, end, &zigzag) )
+    {
+      return false;
+    }
+
+    value = (int32_t)( ( (uint32_t)zigzag >> 1 ) ^ -(uint32_t)( zigzag & 1 ) );
+
+    if(FRAME_TYPE_KEY == frameType)
+    {
+      decoded[slot] = (uint32_t)value;
+    }
+
+    else
+    {
+      decoded[slot] = values[slot] + (uint32_t)value;
+    }
+  }
+
+  // A frame with bytes left over is damaged, or was never a frame at all.
+  if(p != end)
+  {
+    return false;
+  }
+
+  memcpy(values, decoded, numSlots * sizeof(uint32_t));
+  timestamp = ( FRAME_TYPE_KEY == frameType ) ? time : ( timestamp + time );
+  lastSeq = (uint32_t)seq;
+  haveKey = true;
+
+  for(i = 0, slot = 0; i < numMetrics; i++)
+  {
+    if(METRIC_TYPE_HISTOGRAM == metrics[i].type)
+    {
+      for(j = 0; j < metrics[i].numSlots; j++, slot++)
+      {
+        printf( "%llu,%llu,%s[%u],%lu\n", (unsigned long long)seq, (unsigned long long)timestamp,
+                metrics[i].name, j, (unsigned long)values[slot] );
+      }
+    }
+
+    else
+    {
+      // Gauges are signed; counters are not.
+      if(0 == metrics[i].type)
+      {
+        printf( "%llu,%llu,%s,%ld\n", (unsigned long long)seq, (unsigned long long)timestamp,
+                metrics[i].name, (long)(int32_t)values[slot] );
+      }
+
+      else
+      {
+        printf( "%llu,%llu,%s,%lu\n", (unsigned long long)seq, (unsigned long long)timestamp,
+                metrics[i].name, (unsigned long)values[slot] );
+      }
+
+      slot++;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char ** argv)
+{
+  FILE * in;
+  uint8_t * data, * unrolled;
+  size_t size, capacity, n, offset;
+  const uint8_t * p, * end, * payload;
+  uint64_t length;
+  unsigned long numFrames, numBytes, numSkipped;
+  bool ok;
+
+  in = ( argc > 1 ) ? fopen(argv[1], "rb") : stdin;
+
+  if(!in)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  capacity = 1 << 16;
+  size = 0;
+  data = malloc(capacity);
+
+  while( ( n = fread(&data[size], 1, capacity - size, in) ) > 0 )
+  {
+    size += n;
+
+    if(size == capacity)
+    {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+
+  // A ring file: the oldest data starts at the stored write offset.
+  if( ( size >= FILE_HEADER_BYTES ) && !memcmp(data, FILE_MAGIC, 4) )
+  {
+    offset = (size_t)data[4] | ( (size_t)data[5] << 8 ) | ( (size_t)data[6] << 16 ) | ( (size_t)data[7] << 24 );
+
+    if( ( offset < FILE_HEADER_BYTES ) || ( offset > size ) )
+    {
+      offset = FILE_HEADER_BYTES;
+    }
+
+    unrolled = malloc(size);
+    memcpy(unrolled, &data[offset], size - offset);
+    memcpy(&unrolled[size - offset], &data[FILE_HEADER_BYTES], offset - FILE_HEADER_BYTES);
+    size -= FILE_HEADER_BYTES;
+    free(data);
+    data = unrolled;
+  }
+
+  printf("seq,timestamp_us,name,value\n");
+
+  p = data;
+  end = data + size;
+  numFrames = 0;
+  numBytes = 0;
+  numSkipped = 0;
+
+  while(p < end)
+  {
+    // Resynchronise on the next sync byte after any damage.
+    if(FRAME_SYNC != *p)
+    {
+      p++;
+      numSkipped++;
+      continue;
+    }
+
+    payload = p + 1;
+
+    if( !readVarint(&payload, end, &length) || ( length < 1 ) || ( length > (uint64_t)( end - payload ) ) )
+    {
+      p++;
+      numSkipped++;
+      continue;
+    }
+
+    if(FRAME_TYPE_SCHEMA == payload[0])
+    {
+      ok = decodeSchema(payload + 1, payload + length);
+    }
+
+    else if( ( FRAME_TYPE_KEY == payload[0] ) || ( FRAME_TYPE_DELTA == payload[0] ) )
+    {
+      ok = decodeValues(payload[0], payload + 1, payload + length);
+
+      if(ok)
+      {
+        numFrames++;
+        numBytes += (unsigned long)( payload + length - p );
+      }
+    }
+
+    else
+    {
+      ok = false;
+    }
+
+    if(!ok)
+    {
+      haveKey = false;
+      p++;
+      numSkipped++;
+      continue;
+    }
+
+    p = payload + length;
+  }
+
+  fprintf( stderr, "%lu value frames, %.1f bytes/frame, %lu bytes skipped\n",
+           numFrames, numFrames ? (double)numBytes / numFrames : 0.0, numSkipped );
+
+  freeSchema();
+  free(data);
+
+  return 0;
+}